@@ -0,0 +1,159 @@
+#ifndef ACTIONTABLE_HH
+#define ACTIONTABLE_HH
+
+#include <new>
+#include <cerrno>
+#include <cstring>
+
+#include "Common.hh"
+#include "Command.hh"
+#include "Executor.hh"
+
+// command holding a small function object (e.g. Call_N) in place,
+// execution is a call through one function pointer
+class InlineCommand : public Command
+{
+public:
+  enum{STORAGE=6*sizeof(void*)};
+  InlineCommand() : _invoke(0), _destroy(0), _clone(0) {}
+  ~InlineCommand() {reset();}
+  template<class F>
+  void set( const F& f)
+        {
+          // compile error here: F is larger than STORAGE
+          typedef char fits[sizeof(F)<=STORAGE ? 1 : -1];
+          (void)sizeof(fits);
+          reset();
+          new(_storage.buf) F(f);
+          _invoke=&invoke<F>;
+          _destroy=&destroy<F>;
+          _clone=&clone<F>;
+        }
+  // wrap an allocated command, takes ownership of c
+  void adopt( Command* c)
+        {
+          reset();
+          _storage.ptr=c;
+          _invoke=&invokeOwned;
+          _destroy=&destroyOwned;
+        }
+  void reset()
+        {
+          if(_destroy) _destroy(_storage.buf);
+          _invoke=0; _destroy=0; _clone=0;
+        }
+  // allocated copy of a function object set(), 0 for adopted commands
+  InlineCommand* copy() const {return _clone ? _clone(_storage.buf) : 0;}
+  bool valid() const {return _invoke;}
+  int  call() {return _invoke ? _invoke(_storage.buf) : -1;}
+  int  execute() {return call();}
+private:
+  InlineCommand( const InlineCommand&);
+  InlineCommand& operator=( const InlineCommand&);
+
+  int  (*_invoke)(void*);
+  void (*_destroy)(void*);
+  InlineCommand* (*_clone)(const void*);
+  union
+  {
+    char   buf[STORAGE];
+    void*  ptr;
+    double d;
+  } _storage;
+
+  template<class F>
+  static int  invoke( void* p) {return (*static_cast<F*>(p))();}
+  template<class F>
+  static void destroy( void* p) {static_cast<F*>(p)->~F();}
+  template<class F>
+  static InlineCommand* clone( const void* p)
+        {
+          InlineCommand* c=new InlineCommand;
+          c->set(*static_cast<const F*>(p));
+          return c;
+        }
+  static int  invokeOwned( void* p)
+        {return static_cast<Command*>(*static_cast<void**>(p))->execute();}
+  static void destroyOwned( void* p)
+        {delete static_cast<Command*>(*static_cast<void**>(p));}
+};
+
+// key bindings of a UI, one slot per key for dispatch in constant time
+//
+// Bindings are stored in place, binding a key again replaces the previous
+// action. Actions are kept in the order they were first bound for help
+// screens and control glyphs.
+class ActionTable
+{
+public:
+  enum{KEYS=256};
+  ActionTable() : _count(0) {memset(_keys,0,sizeof(_keys));}
+  ~ActionTable() {clear();}
+  // bind a.key to f (e.g. makeCall_1(l,&Launcher::move,char(MSG_LEFT))),
+  // with an executor f is submitted to it instead of being called
+  template<class F>
+  void bind( const Action& a, const F& f, Executor* e=0)
+        {
+          Entry& s=slot(a);
+          s.cmd.set(f);
+          s.executor=e;
+        }
+  // bind a.key to c, takes ownership of c
+  void adopt( const Action& a, Command* c)
+        {
+          Entry& s=slot(a);
+          if(c) s.cmd.adopt(c);
+          else  s.cmd.reset();
+          s.executor=0;
+        }
+  // run the action bound to key, -ENOENT if there is none
+  int execute( int key)
+        {
+          if(key<0 || key>=KEYS || !_keys[key]) return -ENOENT;
+          Entry& e=*_keys[key];
+          if(!e.cmd.valid()) return 0;
+          // the job owns a copy, the action may rebind or clear the key
+          // while it is queued or running
+          if(e.executor) return e.executor->submit(e.cmd.copy()).valid() ?
+                             0 : -EBUSY;
+          return e.cmd.call();
+        }
+  const Action* find( int key) const
+        {
+          if(key<0 || key>=KEYS || !_keys[key]) return 0;
+          return &_keys[key]->action;
+        }
+  // actions in binding order
+  size_t size() const {return _count;}
+  const Action& operator[]( size_t i) const {return _entries[i].action;}
+  void clear()
+        {
+          for( size_t i=0; i<_count; ++i) _entries[i].cmd.reset();
+          memset(_keys,0,sizeof(_keys));
+          _count=0;
+        }
+private:
+  ActionTable( const ActionTable&);
+  ActionTable& operator=( const ActionTable&);
+
+  struct Entry
+  {
+    Entry() : executor(0) {}
+    Action        action;
+    InlineCommand cmd;
+    Executor*     executor;
+  };
+  Entry* _keys[KEYS];
+  Entry  _entries[KEYS];
+  size_t _count;
+
+  Entry& slot( const Action& a)
+        {
+          unsigned char key=a._key;
+          if(!_keys[key]) _keys[key]=&_entries[_count++];
+          _keys[key]->action=a;
+          return *_keys[key];
+        }
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef CALIBRATION_HH
+#define CALIBRATION_HH
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+// running estimate of an endpoint to endpoint time from the last WINDOW
+// observed moves
+//
+// The median ignores single bad samples (e.g. a move blocked by hand) but
+// follows a real change of speed once half the window agrees on it.
+// plausible() screens samples against the median of all recent ones, so
+// a consistent run of new values gets through after a change of speed.
+class SpeedEstimator
+{
+public:
+  enum{WINDOW=9, MIN_SAMPLES=3};
+  SpeedEstimator() : _count(0), _next(0), _rawCount(0), _rawNext(0) {}
+  void add( double t)
+        {
+          _samples[_next]=t;
+          _next=(_next+1)%WINDOW;
+          if(_count<WINDOW) ++_count;
+        }
+  // records t as a raw sample, true if it lies within a quarter of the
+  // raw median, or of value while there are too few raw samples
+  bool   plausible( double t, double value)
+        {
+          _raw[_rawNext]=t;
+          _rawNext=(_rawNext+1)%WINDOW;
+          if(_rawCount<WINDOW) ++_rawCount;
+          double ref = _rawCount>=MIN_SAMPLES ? median(_raw,_rawCount) : value;
+          return ref<=0 || std::fabs(t-ref)<=ref/4;
+        }
+  size_t count() const {return _count;}
+  bool   valid() const {return _count>=MIN_SAMPLES;}
+  double median() const {return median(_samples,_count);}
+  void   reset() {_count=_next=_rawCount=_rawNext=0;}
+private:
+  static double median( const double* samples, size_t count)
+        {
+          if(!count) return 0;
+          double tmp[WINDOW];
+          std::copy(samples,samples+count,tmp);
+          std::nth_element(tmp,tmp+count/2,tmp+count);
+          return tmp[count/2];
+        }
+  double _samples[WINDOW];
+  size_t _count;
+  size_t _next;
+  // all samples, including the ones plausible() turned down
+  double _raw[WINDOW];
+  size_t _rawCount;
+  size_t _rawNext;
+};
+
+// motion of one axis since its last change of direction
+struct AxisMove
+{
+  AxisMove() : dir(0), since(0), from(0), err(-1) {}
+  // direction bit (MSG_*), 0 if the axis is stopped
+  char   dir;
+  // start time and position, err<0 if the position was unknown
+  double since;
+  double from;
+  double err;
+};
+
+// position to time map of one direction of an axis
+//
+// Positions and times are fractions of the range and of the endpoint to
+// endpoint time, counted from the endpoint the direction starts at, so
+// the map keeps its shape when the endpoint times are refined. It is
+// linear unless set from calibration points. Lookups in both directions
+// interpolate on uniform grids precomputed by set() and take constant
+// time.
+class SpeedTable
+{
+public:
+  enum{POINTS=9, GRID=64};
+  SpeedTable() {reset();}
+  // linear map
+  void reset() {set(0,0,0);}
+  // points u[i] reached after t[i], both strictly increasing within
+  // (0,1), the endpoints are implied, false if invalid
+  bool set( const double* u, const double* t, int n)
+        {
+          if(n<0 || n>POINTS) return false;
+          for( int i=0; i<n; ++i)
+              if(u[i]<=(i ? u[i-1] : 0) || u[i]>=1 ||
+                 t[i]<=(i ? t[i-1] : 0) || t[i]>=1) return false;
+          _n=n;
+          _u[0]=0; _t[0]=0;
+          for( int i=0; i<n; ++i) {_u[i+1]=u[i]; _t[i+1]=t[i];}
+          _u[n+1]=1; _t[n+1]=1;
+          sample(_u,_t,_time);
+          sample(_t,_u,_pos);
+          return true;
+        }
+  // calibration points, returns their number
+  int  points( double* u, double* t) const
+        {
+          for( int i=0; i<_n; ++i) {u[i]=_u[i+1]; t[i]=_t[i+1];}
+          return _n;
+        }
+  bool   linear() const {return !_n;}
+  // fraction of the endpoint to endpoint time for reaching u
+  double time( double u) const {return lookup(_time,u);}
+  // position reached after time fraction t
+  double position( double t) const {return lookup(_pos,t);}
+private:
+  int    _n;
+  double _u[POINTS+2];
+  double _t[POINTS+2];
+  double _time[GRID+1];
+  double _pos[GRID+1];
+
+  // y(x) of the polyline through the knots at x=i/GRID
+  void sample( const double* x, const double* y, double* grid) const
+        {
+          int k=0;
+          for( int i=0; i<=GRID; ++i)
+          {
+            double xi=double(i)/GRID;
+            while( k<_n && x[k+1]<xi) ++k;
+            grid[i]=y[k]+(y[k+1]-y[k])*(xi-x[k])/(x[k+1]-x[k]);
+          }
+        }
+  static double lookup( const double* grid, double x)
+        {
+          if(x<=0) return 0;
+          if(x>=1) return 1;
+          double g=x*GRID;
+          int i=int(g);
+          return grid[i]+(grid[i+1]-grid[i])*(g-i);
+        }
+};
+
+// error of a dead-reckoned axis position
+//
+// Wrong endpoint times are the main error and the same for every move in
+// a direction, so their part grows with the distance travelled in that
+// direction since the last endpoint rather than with the number of moves.
+// Timing errors of single commands are independent and add up in var.
+struct AxisError
+{
+  AxisError() : var(0), pos(0), neg(0) {}
+  // drift is the relative error of endpoint times
+  double variance( double drift) const
+        {return var+drift*drift*(pos*pos+neg*neg);}
+  void   move( double d) {if(d>0) pos+=d; else neg-=d;}
+  void   scale( double f) {var*=f; f=std::sqrt(f); pos*=f; neg*=f;}
+  void   reset( double v=0) {var=v; pos=0; neg=0;}
+  double var;
+  double pos;
+  double neg;
+};
+
+// condition a Gaussian position (mean, variance) on lo<=x<=hi, e.g. after
+// a move without hitting an endpoint, returns the factor the variance
+// shrinks by, only matters within a few standard deviations of the limits
+//
+// The mean within the limits stays the most likely position, it isn't
+// moved to the mean of the truncated distribution: an error model that
+// overestimates the drift would push every aim near a limit away from it.
+inline double truncate( double mean, double var, double lo, double hi)
+{
+  if(var<=0) return 1;
+  const double sqrt2=1.4142135623730951, sqrt2pi=2.5066282746310002;
+  double sigma=std::sqrt(var);
+  // one side at a time, the range is much wider than sigma
+  double b=std::min(hi-mean,mean-lo)/sigma;
+  if(b>4) return 1;
+  double pdf=std::exp(-0.5*b*b)/sqrt2pi;
+  double cdf=0.5*erfc(-b/sqrt2);
+  double r=pdf/cdf;
+  return std::max(0.,1-b*r-r*r);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef CLOCK_HH
+#define CLOCK_HH
+
+#include <sys/time.h>
+#include <time.h>
+#include <cerrno>
+#include <unistd.h>
+
+// time source and sleeper policies, times are in seconds
+
+// real time, seconds of CLOCK_MONOTONIC so that NTP adjustments don't
+// disturb timed moves (Reactor arms its timers on the same clock)
+struct SystemClock
+{
+  static const bool realtime=true;
+  static double now()
+        {
+#ifdef CLOCK_MONOTONIC
+          timespec ts;
+          clock_gettime( CLOCK_MONOTONIC, &ts);
+          return ts.tv_sec + ts.tv_nsec*1e-9;
+#else
+          timeval tv;
+          gettimeofday( &tv, 0);
+          return tv.tv_sec + tv.tv_usec*1e-6;
+#endif
+        }
+  static void sleep( double dt) {if(dt>0) usleep(dt*1e6);}
+  static void sleepUntil( double t)
+        {
+#ifdef __linux__
+          timespec ts;
+          ts.tv_sec  = time_t(t);
+          ts.tv_nsec = long((t-ts.tv_sec)*1e9);
+          while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)==EINTR);
+#else
+          sleep(t-now());
+#endif
+        }
+};
+
+// simulated time, only advances when someone sleeps
+struct VirtualClock
+{
+  static const bool realtime=false;
+  static double now() {return time();}
+  static void sleep( double dt) {if(dt>0) time()+=dt;}
+  static void sleepUntil( double t) {if(t>time()) time()=t;}
+  static void set( double t) {time()=t;}
+private:
+  static double& time() {static double t=0; return t;}
+};
+
+#endif
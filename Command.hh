@@ -73,4 +73,47 @@ template<class T,typename RV,typename ARG1,typename ARG2>
 Command* makeTrigger_2( T& l, RV (T::*f)(ARG1,ARG2), ARG1 a1, ARG2 a2)
 {return new Trigger_2<T,RV,ARG1,ARG2>( l, f, a1, a2);}
 
+// copyable function objects for the same bindings, stored in place by
+// InlineCommand instead of being allocated (see ActionTable.hh)
+template<class T,typename RV>
+struct Call_0
+{
+  Call_0( T& t, RV (T::*f)()) : _t(&t),_f(f) {}
+  int operator()() const { (_t->*_f)(); return 0;}
+  T* _t;
+  RV (T::*_f)();
+};
+template<class T,typename RV>
+Call_0<T,RV> makeCall_0( T& l, RV (T::*f)())
+{return Call_0<T,RV>( l, f);}
+
+template<class T,typename RV,typename ARG>
+struct Call_1
+{
+  Call_1( T& t, RV (T::*f)(ARG), ARG a) : _t(&t),_f(f),_a(a) {}
+  int operator()() const { (_t->*_f)(_a); return 0;}
+  T* _t;
+  RV (T::*_f)(ARG);
+  ARG _a;
+};
+template<class T,typename RV,typename ARG>
+Call_1<T,RV,ARG> makeCall_1( T& l, RV (T::*f)(ARG), ARG a)
+{return Call_1<T,RV,ARG>( l, f, a);}
+
+template<class T,typename RV,typename ARG1,typename ARG2>
+struct Call_2
+{
+  Call_2( T& t, RV (T::*f)(ARG1,ARG2), ARG1 a1, ARG2 a2)
+          : _t(&t),_f(f),_a1(a1),_a2(a2) {}
+  int operator()() const { (_t->*_f)(_a1,_a2); return 0;}
+  T* _t;
+  RV (T::*_f)(ARG1,ARG2);
+  ARG1 _a1;
+  ARG2 _a2;
+};
+template<class T,typename RV,typename ARG1,typename ARG2>
+Call_2<T,RV,ARG1,ARG2> makeCall_2( T& l, RV (T::*f)(ARG1,ARG2),
+                                   ARG1 a1, ARG2 a2)
+{return Call_2<T,RV,ARG1,ARG2>( l, f, a1, a2);}
+
 #endif
@@ -1,7 +1,10 @@
 #ifndef COMMON_HH
 #define COMMON_HH
 
-#include <sys/time.h>
+#include "Clock.hh"
+#include "Trace.hh"
+
+#include <string>
 
 enum
 { 
@@ -15,11 +18,45 @@ enum
     MSG_STATUS = 0x40,
 };
 
-struct Timer
+// key binding, actions with cmd set are drawn as controls by the UI
+struct Action
+{
+  Action()
+          : _key(0),_lineOffset(0),_colOffset(0),_fromCenter(false),_cmd(0) {}
+  Action( char key, const std::string& text) 
+          : _key(key),_text(text),_cmd(0) {}
+  Action( char key, const std::string& text, int lineOffset, int colOffset,
+          bool fromCenter, char cmd)
+          : _key(key),_text(text),_lineOffset(lineOffset),
+            _colOffset(colOffset),_fromCenter(fromCenter),_cmd(cmd) {}
+  char _key;
+  std::string _text;
+  int  _lineOffset;
+  int  _colOffset;
+  bool _fromCenter;
+  char _cmd;
+};
+
+// last status report of the device, reused while it is younger than the
+// freshness window to save USB round trips
+template<class Clock=SystemClock>
+class StatusCache
 {
-  timeval tv;
-  void update()    {gettimeofday( &tv, 0);}
-  double toDouble(){return tv.tv_sec + tv.tv_usec*1e-6;}
+public:
+  StatusCache() : _status(0), _time(0), _freshness(0.02), _valid(false) {}
+  bool   fresh() const {return _valid && Clock::now()-_time < _freshness;}
+  char   status() const {return _status;}
+  // a status was stored and not invalidated since
+  bool   valid() const {return _valid;}
+  void   store( char status) {_status=status;_time=Clock::now();_valid=true;}
+  void   invalidate() {_valid=false;}
+  double freshness() const {return _freshness;}
+  void   setFreshness( double freshness) {_freshness=freshness;}
+private:
+  char   _status;
+  double _time;
+  double _freshness;
+  bool   _valid;
 };
 
 #endif
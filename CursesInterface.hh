@@ -5,43 +5,39 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <cstring>
 
 #include <termios.h>
 
-class Command;
+#include "Common.hh"
+#include "ActionTable.hh"
+#include "Trace.hh"
 
-struct Action
-{
-  Action( char key, const std::string& text) 
-          : _key(key),_text(text),_cmd(0) {}
-  Action( char key, const std::string& text, int lineOffset, int colOffset,
-          bool fromCenter, char cmd)
-          : _key(key),_text(text),_lineOffset(lineOffset),
-            _colOffset(colOffset),_fromCenter(fromCenter),_cmd(cmd) {}
-  char _key;
-  std::string _text;
-  int  _lineOffset;
-  int  _colOffset;
-  bool _fromCenter;
-  char _cmd;
-};
+class Command;
 
+// Drawing functions only update a shadow model of the screen (control
+// glyphs, status line and banner), flush() writes what changed since the
+// last frame with a single doupdate().
 class CursesInterface
 {
-  typedef std::vector<std::pair<Action,Command*> > ActionVec;
-
 public:
   CursesInterface()
           : _lines(0), _cols(0), _halfLines(0), _halfCols(0),
-            _debug(false), _status(0), _init(false) {}
+            _debug(false), _status(0), _init(false),
+            _stale(true), _touched(false)
+        {
+          memset(_glyphs,0,sizeof(_glyphs));
+          memset(_shown,0,sizeof(_shown));
+        }
   ~CursesInterface() {resetActions();}
   void resetActions()
         {
-          for( ActionVec::const_iterator it=_actions.begin();
-               it!=_actions.end(); ++it)
-              delete it->second;
           _actions.clear();
+          memset(_glyphs,0,sizeof(_glyphs));
+          memset(_shown,0,sizeof(_shown));
         }
+  ActionTable& actions() {return _actions;}
   void setDebug( bool debug) {_debug=debug;}
   void resizeScreen()
         {
@@ -53,21 +49,62 @@ public:
   
   void redrawScreen()
         {
-          std::string tmp = "WELCOME TO MISSILE COMMAND";
           if(_debug)
           {
-            std::cout << tmp << std::endl;
+            std::cout << "WELCOME TO MISSILE COMMAND" << std::endl;
             return;
           }
-          clear();
-          mvprintw(0,_halfCols - tmp.size()/2, tmp.c_str());
-          mvprintw(_halfLines - 2, _halfCols, " ");
-          mvprintw(_halfLines - 1, _halfCols, "|");
-          mvprintw(_halfLines, _halfCols - 3, " -- -- ");
-          mvprintw(_halfLines + 1, _halfCols, "|");
-          mvprintw(_halfLines + 2, _halfCols, " ");
-          mvprintw(_lines - 1, 0, "press '?' for help, 'q' to quit");
-          refresh();
+          _stale=true;
+          flush();
+        }
+
+  // write the differences between the model and the screen
+  void flush()
+        {
+          if(_debug || !_init) return;
+          TRACE_SCOPE("flush");
+          bool changed = _stale || _touched;
+          if(_stale) drawFrame();
+          for( size_t i=0; i<_actions.size(); ++i)
+          {
+            const Action& a = _actions[i];
+            if(!a._cmd || _glyphs[i]==_shown[i]) continue;
+            int row=a._lineOffset, col=a._colOffset;
+            if( a._fromCenter)
+            {
+              row+=_halfLines;
+              col+=_halfCols;
+            }
+            mvaddch(row,col,_glyphs[i]);
+            _shown[i]=_glyphs[i];
+            changed=true;
+          }
+          if(_statusText!=_statusShown)
+          {
+            move(_lines-2,0);
+            clrtoeol();
+            addnstr(_statusText.c_str(),_cols);
+            _statusShown=_statusText;
+            changed=true;
+          }
+          if(_bannerText!=_bannerShown)
+          {
+            move(4,0);
+            clrtoeol();
+            if(_bannerText.size())
+            {
+              attron(A_STANDOUT);
+              mvaddnstr(4,std::max(0,_halfCols-int(_bannerText.size())/2),
+                        _bannerText.c_str(),_cols);
+              attroff(A_STANDOUT);
+            }
+            _bannerShown=_bannerText;
+            changed=true;
+          }
+          _touched=false;
+          if(!changed) return;
+          wnoutrefresh(stdscr);
+          doupdate();
         }
   
   int open()
@@ -92,8 +129,8 @@ public:
           nodelay(stdscr, TRUE);
           curs_set(0);
           resizeScreen();
-          redrawScreen();
           _init=true;
+          redrawScreen();
           return 0;
         }
   int close()
@@ -107,10 +144,10 @@ public:
             return 0;
           }
           endwin();
+          _init=false;
           return 0;
         }
-  void addAction( const Action& a, Command* c)
-        {_actions.push_back(std::make_pair(a,c));}
+  void addAction( const Action& a, Command* c) {_actions.adopt(a,c);}
   
   void print_status( const std::string& s="")
         {
@@ -118,9 +155,7 @@ public:
             if(s.size()) {std::cout << s << std::endl;}
             return;
           }
-          mvprintw( _lines-2, 0, std::string(_cols,' ').c_str());
-          if(s.size()) mvprintw( _lines-2, 0, s.c_str());
-          refresh();
+          _statusText=s;
         }
   void setStatus(int status)
         {
@@ -131,24 +166,14 @@ public:
   int resetControls(char cmd)
         {
           if(_debug) return 0;
-          // redraw symbols of all non-hidden actions
-          for( ActionVec::const_iterator it=_actions.begin();
-               it!=_actions.end(); ++it) {
-            const Action& a = it->first;
+          // highlight symbols of all non-hidden actions
+          for( size_t i=0; i<_actions.size(); ++i) {
+            const Action& a = _actions[i];
             if(!a._cmd) continue;
-            int row=a._lineOffset, col=a._colOffset;
-            if( a._fromCenter)
-            {
-              row+=_halfLines;
-              col+=_halfCols;
-            }
-            
-            move(row,col);
-            if( (_status & a._cmd)) addch(a._key | A_STANDOUT);
-            else if( cmd == a._cmd) addch(a._key | A_BOLD);
-            else                    addch(a._key | A_NORMAL);
+            if( (_status & a._cmd)) _glyphs[i] = a._key | A_STANDOUT;
+            else if( cmd == a._cmd) _glyphs[i] = a._key | A_BOLD;
+            else                    _glyphs[i] = a._key | A_NORMAL;
           }
-          refresh();
           return 0;
         }
 
@@ -158,16 +183,7 @@ public:
             if(s.size()) {std::cout << s << std::endl;}
             return;
           }
-          if(s.size()) {
-            attron(A_STANDOUT);
-            mvprintw(4,_halfCols - s.size()/2,s.c_str());
-            attroff(A_STANDOUT);
-            refresh();
-          }
-          else {
-            mvprintw(4,0,std::string(_cols,' ').c_str());
-            refresh();
-          }
+          _bannerText=s;
         }
   
   // if != 0, then there is data to be read on stdin
@@ -177,9 +193,10 @@ public:
           struct timeval tv;
           // fd_set passed into select
           fd_set fds;
-          // Set up the timeout.  here we can wait for 1 second
+          // Set up the timeout.  the event loop only calls process() when
+          // stdin is readable, so don't wait at all
           tv.tv_sec = 0;
-          tv.tv_usec = 500000;
+          tv.tv_usec = 0;
           // Zero out the fd_set - make sure it's pristine
           FD_ZERO(&fds);
           // Set the FD that we want to read
@@ -195,8 +212,12 @@ public:
           return FD_ISSET(STDIN_FILENO, &fds);
         }
   
+  // descriptor to watch for input
+  int fd() const {return STDIN_FILENO;}
+  
   int process()
         {
+          TRACE_SCOPE("ui process");
           int c=0;
           if(_debug) {
             if(kbhit()) read(0, &c, 1);
@@ -213,18 +234,16 @@ public:
             std::cout <<std::endl;
             std::cerr << "Got key '" << c << "'" << std::endl;
           }
-          for( ActionVec::const_iterator it=_actions.begin();
-               it!=_actions.end(); ++it) {
-            const Action& a = it->first;
-            if( a._key == c) {
-              if(_debug) std::cerr << "Executing action '" << a._text
-                                   << "' with key '" << a._key << "'"
-                                   << std::endl;
-              print_status(a._text);
-              if( it->second) it->second->execute();
-              if( a._cmd) resetControls( a._cmd);
-              break;
-            }
+          const Action* a = _actions.find(c);
+          if( a) {
+            if(_debug) std::cerr << "Executing action '" << a->_text
+                                 << "' with key '" << a->_key << "'"
+                                 << std::endl;
+            print_status(a->_text);
+            char cmd = a->_cmd;
+            // the action may rebind its own key
+            _actions.execute(c);
+            if( cmd) resetControls( cmd);
           }
           return 0;
         }
@@ -240,6 +259,7 @@ public:
             return buf;
           }
           char buf[11]={0};
+          flush();
           move(_lines-3,0);
           printw(caption.c_str());
           move(_lines-3,caption.size()+1);
@@ -251,7 +271,8 @@ public:
           noecho();
           nodelay(stdscr,true);
           move(_lines-3,0);
-          printw(std::string(_cols,' ').c_str());
+          clrtoeol();
+          _touched=true;
           return buf;
         }
 
@@ -272,9 +293,9 @@ public:
           mvwprintw(hw,col,xoff,"Key  Action");
           std::ostringstream oss;
           oss << "Key  Action" << std::endl;
-          col+= 2; ActionVec::const_iterator it=_actions.begin();
-          for(;it!=_actions.end();++col,++it) {
-            const Action& a = it->first;
+          col+= 2;
+          for( size_t i=0; i<_actions.size(); ++col,++i) {
+            const Action& a = _actions[i];
             oss.str("");
             oss << " '" << a._key << "'" << "  " << a._text;
             mvwprintw(hw,col,xoff,oss.str().c_str());
@@ -297,7 +318,6 @@ public:
           while((c=wgetch(hw))) {
             if(c==KEY_RESIZE) {
               delwin(hw);
-              clear();
               resizeScreen();
               redrawScreen();
               hw = makeHelpWindow();
@@ -308,7 +328,6 @@ public:
             break;
           }
           delwin(hw);
-          clear();
           redrawScreen();
         }
   
@@ -316,24 +335,51 @@ public:
         {
           std::ostringstream oss;
           oss << "Key  Action" << std::endl;
-          for( ActionVec::const_iterator it=_actions.begin();
-               it!=_actions.end(); ++it) {
-            const Action& a = it->first;
+          for( size_t i=0; i<_actions.size(); ++i) {
+            const Action& a = _actions[i];
             oss << " '" << a._key << "'" << "  " << a._text << std::endl;
           }
           return oss.str();
         }
   
 private:
+  // static parts of the screen, everything else is drawn again
+  void drawFrame()
+        {
+          TRACE_SCOPE("redraw");
+          std::string tmp = "WELCOME TO MISSILE COMMAND";
+          erase();
+          mvaddstr(0,std::max(0,_halfCols - int(tmp.size())/2), tmp.c_str());
+          mvaddstr(_halfLines - 1, _halfCols, "|");
+          mvaddstr(_halfLines, _halfCols - 3, " -- -- ");
+          mvaddstr(_halfLines + 1, _halfCols, "|");
+          mvaddstr(_lines - 1, 0, "press '?' for help, 'q' to quit");
+          memset(_shown,0,sizeof(_shown));
+          _statusShown.clear();
+          _bannerShown.clear();
+          _stale=false;
+        }
+
   int _lines;
   int _cols;
   int _halfLines;
   int _halfCols;
-  ActionVec _actions;
+  ActionTable _actions;
   bool _debug;
   int _status;
   termios _term;
   bool _init;
+  // wanted and displayed attributes of each action's glyph
+  chtype _glyphs[ActionTable::KEYS];
+  chtype _shown[ActionTable::KEYS];
+  std::string _statusText;
+  std::string _statusShown;
+  std::string _bannerText;
+  std::string _bannerShown;
+  // whole screen has to be drawn again
+  bool _stale;
+  // drawn outside of flush(), needs a refresh
+  bool _touched;
 };
 
 #endif
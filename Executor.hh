@@ -0,0 +1,273 @@
+#ifndef EXECUTOR_HH
+#define EXECUTOR_HH
+
+#include "Command.hh"
+#include "Trace.hh"
+
+#include <pthread.h>
+
+class Executor;
+
+// a command queued on an executor, shared by the executor and its handles
+class Job
+{
+  friend class Executor;
+  friend class JobHandle;
+public:
+  enum State {QUEUED,RUNNING,DONE,CANCELLED};
+private:
+  Job( Command* c, bool owned, unsigned seq)
+          : _cmd(c), _owned(owned), _seq(seq), _state(QUEUED), _cancel(0),
+            _refs(1), _ret(0) {}
+  ~Job() {if(_owned) delete _cmd;}
+  void ref()   {__atomic_add_fetch(&_refs,1,__ATOMIC_RELAXED);}
+  void unref() {if(!__atomic_sub_fetch(&_refs,1,__ATOMIC_ACQ_REL)) delete this;}
+
+  Command* _cmd;
+  bool     _owned;
+  unsigned _seq;
+  // guarded by the executor mutex
+  int      _state;
+  // set by cancel(), polled by the running command
+  int      _cancel;
+  int      _refs;
+  int      _ret;
+};
+
+// reference to a submitted job
+class JobHandle
+{
+public:
+  JobHandle() : _ex(0), _job(0) {}
+  JobHandle( Executor* ex, Job* job) : _ex(ex), _job(job) {if(_job) _job->ref();}
+  JobHandle( const JobHandle& h) : _ex(h._ex), _job(h._job) {if(_job) _job->ref();}
+  ~JobHandle() {if(_job) _job->unref();}
+  JobHandle& operator=( const JobHandle& h)
+        {
+          if(h._job) h._job->ref();
+          if(_job) _job->unref();
+          _ex=h._ex; _job=h._job;
+          return *this;
+        }
+  bool valid() const {return _job;}
+  // skip the job if still queued, interrupt it if running
+  inline void cancel();
+  // block until the job has finished or was cancelled, returns the
+  // command's return value (don't call with the Launcher locked)
+  inline int  await();
+  inline int  state() const;
+  bool done() const {return state()==Job::DONE || state()==Job::CANCELLED;}
+private:
+  Executor* _ex;
+  Job*      _job;
+};
+
+// runs commands one after the other on a worker thread
+//
+// Jobs are passed through a lock-free single-producer/single-consumer
+// ring, the mutex only protects job states and sleeping. The optional
+// commands are executed on the worker before and after each job
+// (enter/leave) and on the cancelling thread when the running job is
+// cancelled (interrupt), the executor owns them.
+class Executor
+{
+  enum{QUEUE_SIZE=64};
+  friend class JobHandle;
+
+public:
+  Executor( Command* enter=0, Command* leave=0, Command* interrupt=0)
+          : _head(0), _tail(0), _seq(0), _cancelSeq(0), _started(false),
+            _quit(false), _running(0),
+            _enter(enter), _leave(leave), _interrupt(interrupt)
+        {
+          pthread_mutex_init(&_mutex,0);
+          pthread_cond_init(&_work,0);
+          pthread_cond_init(&_done,0);
+        }
+  ~Executor()
+        {
+          stop();
+          delete _enter; delete _leave; delete _interrupt;
+          pthread_cond_destroy(&_done);
+          pthread_cond_destroy(&_work);
+          pthread_mutex_destroy(&_mutex);
+        }
+  int start()
+        {
+          if(_started) return 0;
+          _quit=false;
+          int ret=pthread_create(&_thread,0,&Executor::run,this);
+          if(ret) return -ret;
+          _started=true;
+          return 0;
+        }
+  // cancel everything and join the worker
+  void stop()
+        {
+          if(!_started) return;
+          cancelAll();
+          pthread_mutex_lock(&_mutex);
+          _quit=true;
+          pthread_cond_signal(&_work);
+          pthread_mutex_unlock(&_mutex);
+          pthread_join(_thread,0);
+          _started=false;
+        }
+  // queue c, returns an invalid handle if the queue is full
+  // (single producer, call from one thread only)
+  JobHandle submit( Command* c, bool owned=true)
+        {
+          unsigned tail=_tail;
+          if(tail-__atomic_load_n(&_head,__ATOMIC_ACQUIRE)==QUEUE_SIZE)
+          {
+            if(owned) delete c;
+            return JobHandle();
+          }
+          Job* job=new Job(c,owned,++_seq);
+          JobHandle h(this,job);
+          _ring[tail%QUEUE_SIZE]=job;
+          __atomic_store_n(&_tail,tail+1,__ATOMIC_RELEASE);
+          pthread_mutex_lock(&_mutex);
+          pthread_cond_signal(&_work);
+          pthread_mutex_unlock(&_mutex);
+          return h;
+        }
+  // cancel the running job and everything submitted so far
+  void cancelAll()
+        {
+          pthread_mutex_lock(&_mutex);
+          __atomic_store_n(&_cancelSeq,_seq,__ATOMIC_RELEASE);
+          if(_running) cancelLocked(_running);
+          pthread_mutex_unlock(&_mutex);
+        }
+  bool busy()
+        {
+          pthread_mutex_lock(&_mutex);
+          bool ret = _running ||
+              __atomic_load_n(&_head,__ATOMIC_ACQUIRE)!=
+              __atomic_load_n(&_tail,__ATOMIC_ACQUIRE);
+          pthread_mutex_unlock(&_mutex);
+          return ret;
+        }
+  // cancel flag of the running job, for use by the job itself
+  const int* cancelFlag() const {return _running ? &_running->_cancel : 0;}
+
+private:
+  Executor( const Executor&);
+  Executor& operator=( const Executor&);
+
+  Job*     _ring[QUEUE_SIZE];
+  unsigned _head;
+  unsigned _tail;
+  unsigned _seq;
+  unsigned _cancelSeq;
+  pthread_t       _thread;
+  bool            _started;
+  bool            _quit;
+  pthread_mutex_t _mutex;
+  pthread_cond_t  _work;
+  pthread_cond_t  _done;
+  Job*            _running;
+  Command*        _enter;
+  Command*        _leave;
+  Command*        _interrupt;
+
+  static void* run( void* self) {static_cast<Executor*>(self)->loop();return 0;}
+  Job* pop()
+        {
+          unsigned head=_head;
+          if(head==__atomic_load_n(&_tail,__ATOMIC_ACQUIRE)) return 0;
+          Job* job=_ring[head%QUEUE_SIZE];
+          __atomic_store_n(&_head,head+1,__ATOMIC_RELEASE);
+          return job;
+        }
+  void loop()
+        {
+          TRACE_THREAD("executor");
+          while( true)
+          {
+            Job* job=pop();
+            if(!job)
+            {
+              pthread_mutex_lock(&_mutex);
+              while( !_quit && _head==__atomic_load_n(&_tail,__ATOMIC_ACQUIRE))
+                  pthread_cond_wait(&_work,&_mutex);
+              bool quit = _quit &&
+                  _head==__atomic_load_n(&_tail,__ATOMIC_ACQUIRE);
+              pthread_mutex_unlock(&_mutex);
+              if(quit) break;
+              continue;
+            }
+            pthread_mutex_lock(&_mutex);
+            bool skip = __atomic_load_n(&job->_cancel,__ATOMIC_ACQUIRE) ||
+                job->_seq <= __atomic_load_n(&_cancelSeq,__ATOMIC_ACQUIRE);
+            if(skip) job->_state=Job::CANCELLED;
+            else     {job->_state=Job::RUNNING;_running=job;}
+            pthread_cond_broadcast(&_done);
+            pthread_mutex_unlock(&_mutex);
+            if(!skip)
+            {
+              TRACE_SCOPE("job");
+              if(_enter) _enter->execute();
+              int ret=job->_cmd->execute();
+              if(_leave) _leave->execute();
+              pthread_mutex_lock(&_mutex);
+              job->_ret=ret;
+              job->_state = __atomic_load_n(&job->_cancel,__ATOMIC_ACQUIRE) ?
+                  Job::CANCELLED : Job::DONE;
+              _running=0;
+              pthread_cond_broadcast(&_done);
+              pthread_mutex_unlock(&_mutex);
+            }
+            job->unref();
+          }
+        }
+  void cancelLocked( Job* job)
+        {
+          __atomic_store_n(&job->_cancel,1,__ATOMIC_RELEASE);
+          if(job==_running && _interrupt) _interrupt->execute();
+        }
+};
+
+inline void JobHandle::cancel()
+{
+  if(!_job) return;
+  pthread_mutex_lock(&_ex->_mutex);
+  _ex->cancelLocked(_job);
+  pthread_mutex_unlock(&_ex->_mutex);
+}
+
+inline int JobHandle::await()
+{
+  if(!_job) return -1;
+  pthread_mutex_lock(&_ex->_mutex);
+  while( _job->_state==Job::QUEUED || _job->_state==Job::RUNNING)
+      pthread_cond_wait(&_ex->_done,&_ex->_mutex);
+  int ret=_job->_ret;
+  pthread_mutex_unlock(&_ex->_mutex);
+  return ret;
+}
+
+inline int JobHandle::state() const
+{
+  if(!_job) return Job::CANCELLED;
+  pthread_mutex_lock(&_ex->_mutex);
+  int ret=_job->_state;
+  pthread_mutex_unlock(&_ex->_mutex);
+  return ret;
+}
+
+// submits a command to an executor each time it is executed, e.g. to run
+// blocking launcher functions from key bindings without freezing the UI
+class AsyncTrigger : public Command
+{
+public:
+  AsyncTrigger( Executor& e, Command* c) : _e(e), _c(c) {}
+  ~AsyncTrigger() {delete _c;}
+  int execute() {return _e.submit(_c,false).valid() ? 0 : -1;}
+private:
+  Executor& _e;
+  Command*  _c;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef FLEET_HH
+#define FLEET_HH
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+
+#include "Launcher.hh"
+#include "Reactor.hh"
+#include "Command.hh"
+#include "Executor.hh"
+
+// launchers of all connected devices with the same ids, driven by one
+// event loop instead of a process per device
+//
+// Every launcher keeps its reactor, user interface and executor thread for
+// blocking moves. The fleet loop watches the launchers' reactors (see
+// Reactor::fd()) and steps only those with pending events or a status poll
+// due, an idle fleet sleeps in one wait. Devices are addressed by their
+// path, e.g. bus and ports (see LibUSB10Interface::path()).
+template<class MsgIface, class UserIface, class Clock=SystemClock>
+class Fleet
+{
+public:
+  typedef Launcher<MsgIface,UserIface,Clock> LauncherType;
+
+  Fleet( int vendorID, int deviceID)
+          : _vendor(vendorID), _product(deviceID), _deadline(0), _skew(-1) {}
+  ~Fleet()
+        {
+          for( size_t i=0; i<_launchers.size(); ++i) delete _launchers[i];
+        }
+  // add launchers for the devices that aren't in the fleet yet, returns
+  // the fleet size
+  int scan()
+        {
+          std::vector<std::string> paths;
+          int ret=MsgIface::enumerate(_vendor,_product,paths);
+          if(ret<0) return ret;
+          for( size_t i=0; i<paths.size(); ++i)
+              if(find(paths[i])<0) add(paths[i]);
+          return size();
+        }
+  // launcher for the device at path, connected by connect()
+  LauncherType& add( const std::string& path)
+        {
+          LauncherType* l=new LauncherType(_vendor,_product);
+          l->device().setPath(path);
+          _launchers.push_back(l);
+          _paths.push_back(path);
+          _ready.push_back(false);
+          _connected.push_back(false);
+          _running.push_back(false);
+          return *l;
+        }
+  size_t size() const {return _launchers.size();}
+  LauncherType& operator[]( size_t i) {return *_launchers[i];}
+  const std::string& path( size_t i) const {return _paths[i];}
+  // index of the launcher at path, -1 if none
+  int find( const std::string& path) const
+        {
+          for( size_t i=0; i<_paths.size(); ++i)
+              if(_paths[i]==path) return i;
+          return -1;
+        }
+  // connect all launchers, stops at the first failure
+  int connect()
+        {
+          for( size_t i=0; i<_launchers.size(); ++i)
+          {
+            if(_connected[i]) continue;
+            int ret=_launchers[i]->connect();
+            if(ret) return ret;
+            _connected[i]=_running[i]=true;
+            _loop.add(_launchers[i]->fd(),POLLIN,
+                      makeTrigger_1(*this,&Fleet::ready,i));
+          }
+          return 0;
+        }
+  // disconnect the connected launchers, returns the first error
+  int disconnect()
+        {
+          int ret=0;
+          for( size_t i=0; i<_launchers.size(); ++i)
+          {
+            if(!_connected[i]) continue;
+            _loop.remove(_launchers[i]->fd());
+            _connected[i]=_running[i]=false;
+            int err=_launchers[i]->disconnect();
+            if(!ret) ret=err;
+          }
+          return ret;
+        }
+  // wait for events of any launcher or the first status poll due and
+  // process them, false once all launchers stopped
+  bool process()
+        {
+          double next=-1;
+          for( size_t i=0; i<_launchers.size(); ++i)
+              if(_running[i] && (next<0 || _launchers[i]->nextPoll()<next))
+                  next=_launchers[i]->nextPoll();
+          if(next<0) return false;
+          _loop.waitUntil<Clock>(next);
+          double now=Clock::now();
+          bool running=false;
+          for( size_t i=0; i<_launchers.size(); ++i)
+          {
+            if(!_running[i]) continue;
+            if(_ready[i] || now>=_launchers[i]->nextPoll())
+            {
+              _ready[i]=false;
+              _running[i]=_launchers[i]->step();
+            }
+            running|=_running[i];
+          }
+          if(_salvo.size() && !salvoRunning()) finishSalvo();
+          return running;
+        }
+  // fire all running launchers at once, their fire commands arrive lead
+  // seconds from now (see Launcher::fireAt()), staging and firing run on
+  // the launchers' executors, -EBUSY while the last salvo is running
+  int salvo( double lead)
+        {
+          if(salvoRunning()) return -EBUSY;
+          _deadline=Clock::now()+lead;
+          _skew=-1;
+          _salvo.assign(_launchers.size(),JobHandle());
+          for( size_t i=0; i<_launchers.size(); ++i)
+              if(_running[i])
+                  _salvo[i]=_launchers[i]->submit(
+                      makeTrigger_1(*_launchers[i],&LauncherType::fireAt,
+                                    _deadline));
+          return 0;
+        }
+  bool salvoRunning() const
+        {
+          for( size_t i=0; i<_salvo.size(); ++i)
+              if(_salvo[i].valid() && !_salvo[i].done()) return true;
+          return false;
+        }
+  // spread of the fire command arrivals of the last salvo in seconds, -1
+  // while it runs or if a launcher didn't fire
+  double skew() const {return _skew;}
+private:
+  Fleet( const Fleet&);
+  Fleet& operator=( const Fleet&);
+
+  int _vendor;
+  int _product;
+  std::vector<LauncherType*> _launchers;
+  std::vector<std::string>   _paths;
+  // launchers with pending events, set by the loop handlers
+  std::vector<bool> _ready;
+  std::vector<bool> _connected;
+  // launchers connected and not stopped
+  std::vector<bool> _running;
+  Reactor _loop;
+  // fireAt() jobs of the last salvo
+  std::vector<JobHandle> _salvo;
+  double _deadline;
+  double _skew;
+
+  int ready( size_t i) {_ready[i]=true; return 0;}
+  // skew of the salvo, reported to every launcher's user interface
+  void finishSalvo()
+        {
+          double first=0, last=0;
+          int n=0, failed=0;
+          for( size_t i=0; i<_salvo.size(); ++i)
+          {
+            if(!_salvo[i].valid()) continue;
+            double t=_launchers[i]->fired();
+            if(t<0) {++failed; continue;}
+            if(!n || t<first) first=t;
+            if(!n || t>last)  last=t;
+            ++n;
+          }
+          if(!failed) _skew=last-first;
+          std::ostringstream oss;
+          oss << "Salvo: " << n << " launchers fired";
+          if(failed) oss << ", " << failed << " failed";
+          if(n) oss << ", skew " << (last-first)*1e3 << " ms, last "
+                    << (last-_deadline)*1e3 << " ms after the deadline";
+          for( size_t i=0; i<_salvo.size(); ++i)
+              if(_salvo[i].valid()) _launchers[i]->ui().print_status(oss.str());
+          _salvo.clear();
+        }
+};
+
+#endif
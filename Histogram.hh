@@ -0,0 +1,89 @@
+#ifndef HISTOGRAM_HH
+#define HISTOGRAM_HH
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+#include <stdint.h>
+
+// latency histogram with logarithmic buckets, each power of two is split
+// into 32 linear sub-buckets (about 3% resolution), values are in seconds
+// and recorded with nanosecond granularity
+class Histogram
+{
+  enum{SUB_BITS=5, SUB=1<<SUB_BITS, GROUPS=64-SUB_BITS+1};
+
+public:
+  Histogram() : _counts(GROUPS*SUB,0) {reset();}
+  void reset()
+        {
+          std::fill(_counts.begin(),_counts.end(),0);
+          _n=0; _sum=0; _min=0; _max=0;
+        }
+  void add( double t)
+        {
+          uint64_t ns = t>0 ? uint64_t(t*1e9+0.5) : 0;
+          ++_counts[index(ns)];
+          if(!_n || ns<_min) _min=ns;
+          if(ns>_max) _max=ns;
+          _sum+=t;
+          ++_n;
+        }
+  uint64_t count() const {return _n;}
+  double   min()   const {return _min*1e-9;}
+  double   max()   const {return _max*1e-9;}
+  double   mean()  const {return _n ? _sum/_n : 0;}
+  // smallest value with at least fraction p of all samples below or at it
+  double   percentile( double p) const
+        {
+          if(!_n) return 0;
+          uint64_t rank = uint64_t(p*_n+0.999999);
+          if(rank<1) rank=1;
+          uint64_t seen=0;
+          for( size_t i=0; i<_counts.size(); ++i)
+          {
+            seen+=_counts[i];
+            if(seen>=rank) return std::min(value(i),_max)*1e-9;
+          }
+          return max();
+        }
+  // one line per non-empty bucket: upper bound in ms, count and a bar
+  void print( std::ostream& os, int width=50) const
+        {
+          uint64_t peak=0;
+          for( size_t i=0; i<_counts.size(); ++i)
+              if(_counts[i]>peak) peak=_counts[i];
+          for( size_t i=0; i<_counts.size(); ++i)
+          {
+            if(!_counts[i]) continue;
+            os << std::setw(12) << std::fixed << std::setprecision(4)
+               << value(i)*1e-6 << "ms " << std::setw(8) << _counts[i] << " "
+               << std::string(_counts[i]*width/peak,'#') << std::endl;
+          }
+          os.unsetf(std::ios::floatfield);
+        }
+private:
+  std::vector<uint64_t> _counts;
+  uint64_t _n;
+  double   _sum;
+  uint64_t _min;
+  uint64_t _max;
+
+  static size_t index( uint64_t v)
+        {
+          if(v<SUB) return v;
+          int shift = 63-__builtin_clzll(v)-SUB_BITS;
+          return (shift+1)*SUB + (v>>shift)-SUB;
+        }
+  // upper bound of bucket i
+  static uint64_t value( size_t i)
+        {
+          size_t group=i/SUB, sub=i%SUB;
+          if(!group) return sub;
+          return ((uint64_t(SUB+sub)+1)<<(group-1))-1;
+        }
+};
+
+#endif
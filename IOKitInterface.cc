@@ -4,9 +4,56 @@
 #include <IOKit/usb/USBSpec.h>
 
 #include <iostream>
+#include <cstdio>
+#include <algorithm>
 
 #include "IOKitInterface.hh"
 
+io_iterator_t IOKitInterface::matching( int vendor, int product)
+{
+  CFMutableDictionaryRef matchingDictionary =
+      IOServiceMatching(kIOUSBDeviceClassName);
+  SInt32 idVendor  = vendor;
+  SInt32 idProduct = product;
+  CFDictionaryAddValue(
+      matchingDictionary, CFSTR(kUSBVendorID),
+      CFNumberCreate(kCFAllocatorDefault,kCFNumberSInt32Type,&idVendor));
+  CFDictionaryAddValue(
+      matchingDictionary, CFSTR(kUSBProductID),
+      CFNumberCreate(kCFAllocatorDefault,kCFNumberSInt32Type,&idProduct));
+  io_iterator_t iterator = 0;
+  IOServiceGetMatchingServices(
+      kIOMasterPortDefault,matchingDictionary, &iterator);
+  return iterator;
+}
+
+std::string IOKitInterface::path( io_service_t usbRef)
+{
+  UInt32 location=0;
+  CFTypeRef ref = IORegistryEntryCreateCFProperty(
+      usbRef, CFSTR(kUSBDevicePropertyLocationID), kCFAllocatorDefault, 0);
+  if(ref) {
+    CFNumberGetValue((CFNumberRef)ref,kCFNumberSInt32Type,&location);
+    CFRelease(ref);
+  }
+  char buf[16];
+  snprintf(buf,sizeof(buf),"0x%08x",(unsigned)location);
+  return buf;
+}
+
+int IOKitInterface::enumerate( int vendor, int product,
+                               std::vector<std::string>& paths)
+{
+  paths.clear();
+  io_iterator_t iterator = matching(vendor,product);
+  while( io_service_t usbRef = IOIteratorNext(iterator)) {
+    paths.push_back(path(usbRef));
+    IOObjectRelease(usbRef);
+  }
+  IOObjectRelease(iterator);
+  return paths.size();
+}
+
 IOReturn IOKitInterface::open()
 {
   IOReturn ret=0;
@@ -56,21 +103,12 @@ IOReturn IOKitInterface::openDevice()
 {
   if(_dev) return -1;
   IOReturn ret=0;
-  // try finding device
-  CFMutableDictionaryRef matchingDictionary =
-      IOServiceMatching(kIOUSBDeviceClassName);
-  SInt32 idVendor  = _vendor;
-  SInt32 idProduct = _product;
-  CFDictionaryAddValue(
-      matchingDictionary, CFSTR(kUSBVendorID),
-      CFNumberCreate(kCFAllocatorDefault,kCFNumberSInt32Type,&idVendor));
-  CFDictionaryAddValue(
-      matchingDictionary, CFSTR(kUSBProductID),
-      CFNumberCreate(kCFAllocatorDefault,kCFNumberSInt32Type,&idProduct));
-  io_iterator_t iterator = 0;
-  IOServiceGetMatchingServices(
-      kIOMasterPortDefault,matchingDictionary, &iterator);
-  io_service_t usbRef = IOIteratorNext(iterator);
+  // try finding device, the first one or the one at _path
+  io_iterator_t iterator = matching(_vendor,_product);
+  io_service_t usbRef;
+  while( (usbRef = IOIteratorNext(iterator)) &&
+         !_path.empty() && path(usbRef)!=_path)
+      IOObjectRelease(usbRef);
   IOObjectRelease(iterator);
   if(!usbRef) {
     std::cerr << "Device not found" << std::endl;
@@ -216,12 +254,34 @@ IOReturn IOKitInterface::close()
     (*_dev)->Release(_dev);
     _dev=0;
   }
-          
+  _lost=false;
   return 0;
 }
 
+IOReturn IOKitInterface::recover()
+{
+  if(!_lost) return kIOReturnSuccess;
+  close();
+  _lost=true;
+  std::vector<std::string> paths;
+  enumerate(_vendor,_product,paths);
+  if(paths.empty() ||
+     (!_path.empty() &&
+      std::find(paths.begin(),paths.end(),_path)==paths.end()))
+      return kIOReturnNoDevice;
+  _lost=false;
+  IOReturn ret=open();
+  if(ret!=kIOReturnSuccess) {
+    close();
+    _lost=true;
+  }
+  return ret;
+}
+
 IOReturn IOKitInterface::send( char msg)
 {
+  TRACE_SCOPE("send");
+  if(_lost) return kIOReturnNoDevice;
   if(!_dev) return -1;
   const int bufsize=8;
   UInt8 buf[bufsize];
@@ -236,7 +296,7 @@ IOReturn IOKitInterface::send( char msg)
   request.wLength =bufsize;
   request.pData   =buf;
   IOReturn ret=(*_dev)->DeviceRequest(_dev,&request);
-  return ret;
+  return lostIf(ret);
 }
 
 IOReturn IOKitInterface::print_settings()
@@ -321,7 +381,13 @@ IOReturn IOKitInterface::checkPipe(UInt8 pipeRef)
   
 IOReturn IOKitInterface::read( char* status)
 {
+  TRACE_SCOPE("read");
+  if(_lost) return kIOReturnNoDevice;
   if(!_interface) return -1;
+  if(_cache.fresh()) {
+    if(status) *status = _cache.status();
+    return kIOReturnSuccess;
+  }
   UInt8 pipeRef = 1;
   IOReturn ret=0;
   ret = send(MSG_STATUS);
@@ -336,10 +402,12 @@ IOReturn IOKitInterface::read( char* status)
   CFRunLoopRunInMode(mode, seconds, returnAfterSourceHandled);  
   if(_debug) std::cerr << "Reading from pipe" << ret << std::endl;
   ret = (*_interface)->ReadPipe(_interface,pipeRef,&buf,&actual_xfer);
+  lostIf(ret);
   if(ret!=kIOReturnSuccess) return print_error("ReadPipe",ret);
   if(actual_xfer != bufsize)
       std::cerr << "Read " << actual_xfer << "/" << bufsize
                 << " bytes" << std::endl;
+  _cache.store(*buf);
   if(status) *status = *buf;
   return ret;
 }
@@ -4,8 +4,10 @@
 #include <IOKit/IOReturn.h>
 #include <IOKit/usb/IOUSBLib.h>
 #include <string>
+#include <vector>
 
 #include "Common.hh"
+#include "Reactor.hh"
 
 class IOKitInterface
 {
@@ -28,7 +30,7 @@ class IOKitInterface
 public:
   IOKitInterface( int vendor, int product, char statusMsg)
           : _dev(0), _interface(0), _vendor(vendor), _product(product),
-            _statusMsg(statusMsg), _debug(false)
+            _statusMsg(statusMsg), _debug(false), _lost(false)
         {
           // The hex values passed into the control_msg() method define how the
           // USB interface passes the control byte on to the controller
@@ -55,16 +57,49 @@ public:
             RecvCmd recv_cmd = {0};_recv_cmd=recv_cmd;
           }
         }
+  // paths of all devices matching vendor and product (see path()),
+  // returns their number
+  static int enumerate( int vendor, int product,
+                        std::vector<std::string>& paths);
+  // location ID in hex (e.g. 0x14200000), it encodes the bus and ports
+  static std::string path( io_service_t usbRef);
+  // open the device at path instead of the first match, empty for any
+  void setPath( const std::string& path) {_path=path;}
+  const std::string& path() const {return _path;}
   IOReturn open();
   IOReturn openDevice();
   IOReturn openInterface();
   IOReturn setConfiguration();
   IOReturn close();
+  // true once the device was unplugged or stopped responding, the other
+  // calls fail until recover() succeeded
+  bool     lost() const {return _lost;}
+  // reopen a lost device, fails fast while it isn't on the bus
+  IOReturn recover();
   IOReturn send( char msg);
+  // transfers are synchronous, send immediately
+  IOReturn post( char msg) {_cache.invalidate();return send(msg);}
+  // send msg and refresh the status cache
+  IOReturn postRead( char msg)
+        {
+          IOReturn ret=post(msg);
+          if(ret) return ret;
+          return read(0);
+        }
+  IOReturn poll() {return 0;}
+  int      pending() const {return 0;}
+  // synchronous transfers only, the status is polled
+  IOReturn stream( bool on) {return on ? kIOReturnUnsupported : 0;}
+  void     setStatusHandler( Command* c) {delete c;}
+  // no pollable descriptors, the event loop falls back to its timeout
+  void     attach( Reactor&) {}
+  void     detach() {}
   IOReturn print_settings();
   IOReturn resetPipe(UInt8 pipeRef);
   IOReturn checkPipe(UInt8 pipeRef);
   IOReturn read( char* status);
+  // time in seconds a status report is reused by read()
+  void     setStatusFreshness( double s) {_cache.setFreshness(s);}
   void     setDebug(bool debug) {_debug=debug;}
 private:
   IOUSBDeviceInterface300**    _dev;
@@ -73,10 +108,22 @@ private:
   int     _product;
   char    _statusMsg;
   bool    _debug;
+  bool    _lost;
+  std::string _path;
+  StatusCache<> _cache;
   
   SendCmd _send_cmd;
   RecvCmd _recv_cmd;
 
+  // iterator over the devices matching vendor and product
+  static io_iterator_t matching( int vendor, int product);
+  // errors after which the device has to be reopened
+  IOReturn    lostIf( IOReturn ret)
+        {
+          if(ret==kIOReturnNoDevice || ret==kIOReturnNotResponding)
+              _lost=true;
+          return ret;
+        }
   IOReturn    print_error( const std::string& name, IOReturn code);
   const char* str_return(IOReturn err);
 };
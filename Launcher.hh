@@ -2,27 +2,55 @@
 #define LAUNCHER_HH
 
 #include "Common.hh"
+#include "Clock.hh"
 #include "Command.hh"
+#include "Reactor.hh"
+#include "Scheduler.hh"
+#include "Thread.hh"
+#include "Executor.hh"
+#include "StatusBoard.hh"
+#include "StateFile.hh"
+#include "Calibration.hh"
+#include "Planner.hh"
+#include "Poller.hh"
 
 #include <sstream>
+#include <vector>
 #include <cstring>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <unistd.h>
+#include <algorithm>
+#include <ctime>
 
 class Action;
 class Command;
 
-template<class MsgIface, class UserIface>
+// Clock is the time source and sleeper (see Clock.hh), VirtualClock
+// together with a simulated MsgIface runs faster than real time
+//
+// Blocking functions may run on the executor thread (see async()), the
+// launcher lock serializes them with the main loop and is released while
+// they sleep.
+template<class MsgIface, class UserIface, class Clock=SystemClock>
 class Launcher
 {
 public:
   Launcher( int vendorID, int deviceID)
-          : _mi(vendorID,deviceID,MSG_STATUS) {init();}
+          : _mi(vendorID,deviceID,MSG_STATUS), _scheduler(_sleep),
+            _executor(makeTrigger_0(*this,&Launcher::beginJob),
+                      makeTrigger_0(*this,&Launcher::endJob),
+                      makeTrigger_0(_sleep,&Reactor::wake))
+        {
+          _loop.setLock(&_lock);
+          _sleep.setLock(&_lock);
+          init();
+        }
   // read status (non-blocking)
   int  update_status();
-  // wait for status bit 'cmd' (blocking)
+  // wait for status bit 'cmd' (blocking), -EINTR if cancelled, returns
+  // early once cmd isn't sent anymore
   int  wait(char cmd);
   // send cmd (non-blocking)
   int  move(char cmd);
@@ -30,24 +58,59 @@ public:
   int  moveHome( char cmd);
   // move for dt in seconds (blocking)
   void moveTimed( char cmd, double dt);
+  // move two axes at once for dt1 and dt2 seconds (blocking)
+  void moveTimed2( char cmd1, double dt1, char cmd2, double dt2);
   // move relative to current position (blocking)
   int  moveRel( double theta, double phi);
   // move to absolute coordinates (blocking)
   int  moveAbs( double theta, double phi);
+  // time moveAbs() takes between two positions, not counting homing
+  double moveTime( double theta0, double phi0,
+                   double theta1, double phi1) const;
+  // order of targets with the least travel time from the current
+  // position (see Planner.hh), returns that time
+  double planSequence( const std::vector<Target>& targets,
+                       std::vector<int>& order) const;
+  // visit targets in the order of planSequence(), which is repeated after
+  // each target from the position reached (blocking)
+  int  visit( const std::vector<Target>& targets);
+  // targets for runSequence(), e.g. for key bindings
+  void setSequence( const std::vector<Target>& targets) {_sequence=targets;}
+  int  runSequence() {return visit(_sequence);}
   // start firing and stop after status bit flipped (blocking)
   int  fire();
   // start firing and stop after timeout (blocking)
   int  fireTimeout(double timeout);
-  // process event loop
+  // stop and measure the send latency, then fire so that the command
+  // arrives at deadline on Clock and stop after the status bit (blocking),
+  // e.g. for a salvo of several launchers (see Fleet.hh)
+  int  fireAt( double deadline);
+  // completion time of the fire command sent by fireAt(), -1 if failed
+  double fired() const {return _fired;}
+  // median time of n blocking sends, sends MSG_STOP (blocking)
+  int  measureLatency( int n);
+  double sendLatency() const {return _sendLatency;}
+  // wait for input, USB events or the next status poll and process them
   bool process();
-  // trigger dialog for moveRel arguments
+  // process ready events and a due status poll without waiting, for
+  // driving the launcher from another loop watching fd() (see Fleet.hh)
+  bool step();
+  // readable while events are pending
+  int    fd() const {return _loop.fd();}
+  // time of the next status poll on Clock
+  double nextPoll() const {return _nextPoll;}
+  // trigger dialog for moveRel arguments, the move runs on the executor
   void goRel();
-  // trigger dialog for moveAbs arguments
+  // trigger dialog for moveAbs arguments, the move runs on the executor
   void goAbs();
   // go to upper-right endpoints, calibrating (0,0)
   void goHome();
-  // run calibration pattern for measuring theta/phi pos/neg times
+  // run calibration pattern for measuring theta/phi pos/neg times, moves
+  // between endpoints refine them continuously (see endpoints())
   void calibrate();
+  // stop at several points in each direction and ask for the angle
+  // reached, for speeds that vary over the range (see SpeedTable)
+  void calibrateTables();
   // connect to USB device and start UI
   int  connect();
   // disconnect from USB device and stop UI
@@ -58,6 +121,19 @@ public:
   void printStatusMV();
   // print key bindings
   void printHelp();
+  // publish the launcher state in shared memory (see StatusBoard.hh)
+  int  openStatusBoard( const std::string& name) {return _board.open(name);}
+  // keep calibration and position in a file (see StateFile.hh), connect()
+  // restores them and they are saved whenever the launcher stops
+  int  openStateFile( const std::string& path) {return _state.open(path);}
+  // write recorded trace events as Chrome trace JSON ('make TRACE=1')
+  int  dumpTrace( const char* file);
+  // run c on the executor thread, the handle can cancel or await it
+  JobHandle submit( Command* c) {return _executor.submit(c);}
+  // command for key bindings that submits c each time it is executed
+  Command*  async( Command* c) {return new AsyncTrigger(_executor,c);}
+  // cancel running and queued jobs and stop the launcher
+  int  halt();
 
   int  stop() {_start =-1;return 0;}
   double thetaMin() const {return _thetaMin;}
@@ -78,8 +154,34 @@ public:
   double phiNeg()   const {return _phiNeg;}
   void   setPhiPosNeg( double pos, double neg)
         {_phiPos = pos;_phiNeg=neg;}
+  // position to time map of direction cmd (MSG_DOWN, ...), linear by
+  // default
+  SpeedTable& table( char cmd)
+        {
+          if(cmd & MSG_DOWN) return _thetaPosTable;
+          if(cmd & MSG_UP)   return _thetaNegTable;
+          if(cmd & MSG_LEFT) return _phiPosTable;
+          return _phiNegTable;
+        }
   double theta()    const {return _theta;}
   double phi()      const {return _phi;}
+  // variance and standard deviation of theta/phi, grows with every move
+  // and is reset at endpoints
+  double thetaVar() const {return _thetaError.variance(_drift);}
+  double phiVar()   const {return _phiError.variance(_drift);}
+  double thetaErr() const {return std::sqrt(thetaVar());}
+  double phiErr()   const {return std::sqrt(phiVar());}
+  // relative error of the endpoint times, e.g. 0.02 for 2%
+  double drift()    const {return _drift;}
+  void   setDrift( double drift) {_drift=drift;}
+  // jitter of the time a command takes effect in seconds, on top of the
+  // measured send time
+  double latency()  const {return _latency;}
+  void   setLatency( double latency) {_latency=latency;}
+  // moveAbs() first homes axes whose error at the target would exceed
+  // budget degrees, 0 never homes
+  double aimBudget() const {return _aimBudget;}
+  void   setAimBudget( double budget) {_aimBudget=budget;}
   bool   calibrated() const
         {return minMaxValid() && posValid() && speedValid();}
   bool   minMaxValid() const
@@ -89,12 +191,73 @@ public:
               _phiMin<=_phi && _phi<=_phiMax;}
   bool   speedValid() const
         {return _thetaPos>0 && _thetaNeg>0 && _phiPos>0 && _phiNeg>0;}
+  // send combined direction bits to move theta and phi concurrently
+  bool   combinedMoves() const {return _combined;}
+  void   setCombinedMoves( bool combined) {_combined=combined;}
+  // seconds between status polls in process() while moving, the polls
+  // back off up to the idle interval while nothing happens
+  double pollInterval() const {return _poller.active();}
+  void   setPollInterval( double interval) {_poller.setActive(interval);}
+  void   setIdlePollInterval( double interval) {_poller.setIdle(interval);}
+  const Poller& poller() const {return _poller;}
   void   setDebug( bool debug)
         {_debug=debug;_mi.setDebug(debug);_ui.setDebug(debug);}
   void   addAction( const Action& a, Command* c) {_ui.addAction(a,c);}
+  // bind a key to f without allocating, f is e.g.
+  // makeCall_1(l,&Launcher::move,char(MSG_LEFT)) (see ActionTable.hh)
+  template<class F>
+  void   bind( const Action& a, const F& f) {_ui.actions().bind(a,f);}
+  // same, f runs on the executor
+  template<class F>
+  void   bindAsync( const Action& a, const F& f)
+        {_ui.actions().bind(a,f,&_executor);}
+  // access to the message interface, e.g. for backend specific settings
+  MsgIface& device() {return _mi;}
+  // access to the user interface
+  UserIface& ui() {return _ui;}
+  // submit delays and overshoots of the stop commands of timed moves
+  const Scheduler<Clock>& scheduler() const {return _scheduler;}
+  // false while the status poll is reopening a lost device (see
+  // reconnect())
+  bool   connected() const {return _lostAt<0;}
+  // number of reconnects, seconds from noticing the loss to the reconnect
+  int    reconnects() const {return _reconnects;}
+  double lastReconnect() const {return _lastReconnect;}
+  double maxReconnect() const {return _maxReconnect;}
 private:
   void adjust(char cmd, double dt);
+  void moved( char cmd, double sent, double now);
+  void switched( char from, char to, double timing);
+  void rehome( double theta, double phi);
   void init();
+  void publish();
+  void save();
+  void restore();
+  void endpoints( char status);
+  void track( AxisMove& m, char dir, double pos, double err, bool known,
+              double now);
+  void sample( AxisMove& m, double start, double range, double now,
+               const SpeedTable& table, SpeedEstimator& est, double& value);
+  // time for moving an axis from a to b and position after moving for dt
+  // in the positive or negative direction, along the speed tables
+  static double travelTime( double a, double b, double min, double max,
+                            double pos, const SpeedTable& tp,
+                            double neg, const SpeedTable& tn);
+  static double travel( double a, bool positive, double dt,
+                        double min, double max,
+                        double pos, const SpeedTable& tp,
+                        double neg, const SpeedTable& tn);
+  bool calibrateTable( char cmd);
+  bool dispatch();
+  void reconnect( double now);
+  void schedulePoll( double now, bool active);
+  int  statusChanged();
+  void wakePoll( double now);
+  double endpointDue( double& window) const;
+  // executor hooks, a job runs locked and aborts _sleep when cancelled
+  void beginJob();
+  void endJob();
+  bool aborted() const {return _sleep.aborted();}
   
   char     _current;
   char     _statusOld;
@@ -109,11 +272,60 @@ private:
   double   _thetaNeg;
   double   _phiPos;
   double   _phiNeg;
+  // position estimate: _theta/_phi are the means
+  AxisError _thetaError;
+  AxisError _phiError;
+  double   _drift;
+  double   _latency;
+  double   _aimBudget;
+  // send time measured by measureLatency(), completion of the last fireAt()
+  double   _sendLatency;
+  double   _fired;
+  // endpoint to endpoint times observed during normal moves
+  AxisMove _thetaMove;
+  AxisMove _phiMove;
+  SpeedEstimator _thetaPosEst;
+  SpeedEstimator _thetaNegEst;
+  SpeedEstimator _phiPosEst;
+  SpeedEstimator _phiNegEst;
+  SpeedTable _thetaPosTable;
+  SpeedTable _thetaNegTable;
+  SpeedTable _phiPosTable;
+  SpeedTable _phiNegTable;
+  std::vector<Target> _sequence;
+  char     _seen;
   MsgIface  _mi;
   UserIface _ui;
   bool _debug;
+  bool _combined;
   
-  Timer _timer;
+  // main loop: user input, USB events and status polling
+  Reactor _loop;
+  // blocking moves: USB events only
+  Reactor _sleep;
+  double  _nextPoll;
+  Poller  _poller;
+  // end of the running timed move, -1 if none
+  double  _stopAt;
+  // deadline of a timed move stopped on time, its overshoot is recorded
+  // with the next status (-1 if none)
+  double  _overshootDue;
+  // the interface streams the status while moving (see moved())
+  bool    _streaming;
+  // last good status read, loss of the device noticed (-1 if connected)
+  double  _statusTime;
+  double  _lostAt;
+  int     _reconnects;
+  double  _lastReconnect;
+  double  _maxReconnect;
+  // sends MSG_STOP at the end of timed moves
+  Scheduler<Clock> _scheduler;
+  StatusBoard _board;
+  StateFile   _state;
+  uint32_t    _updates;
+  Mutex    _lock;
+  // runs blocking functions, declared last so that it is stopped first
+  Executor _executor;
 };
 
 #include "Launcher.icc"
@@ -4,10 +4,26 @@
 #include <libusb.h>
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include "Common.hh"
+#include "Reactor.hh"
+
+// hotplug events came with libusb 1.0.16
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION>=0x01000102
+#define HAVE_LIBUSB_HOTPLUG
+#endif
 
 class LibUSB10Interface
 {
   enum{XFER_BULK,XFER_INT};
+  // number of preallocated control transfers that can be in flight
+  enum{QUEUE_SIZE=8};
+  enum{BUF_SIZE=8};
   struct SendCmd
   {
     int RequestType;
@@ -22,12 +38,27 @@ class LibUSB10Interface
     int Endpoint;
     int Timeout;
   };
+  // preallocated transfer plus its buffer, filled in by the callback
+  struct Slot
+  {
+    libusb_transfer* xfer;
+    unsigned char    buf[LIBUSB_CONTROL_SETUP_SIZE+BUF_SIZE];
+    int              done;
+    int              ret;
+  };
   
 public:
   LibUSB10Interface( int vendor, int product, char statusMsg)
-          : _dev(0), _interface(0), _vendor(vendor), _product(product),
-            _statusMsg(statusMsg), _debug(false), _init(false)
+          : _ctx(0), _dev(0), _interface(0), _vendor(vendor),
+            _product(product),
+            _statusMsg(statusMsg), _debug(false), _init(false),
+            _lost(false), _left(false), _arrived(false), _hotplug(false),
+            _head(0), _tail(0), _inPending(false), _stale(false),
+            _stream(false),
+            _delivered(0), _handler(0)
         {
+          memset(_queue,0,sizeof(_queue));
+          memset(&_in,0,sizeof(_in));
           // The hex values passed into the control_msg() method define how the
           // USB interface passes the control byte on to the controller
           if( _vendor == 0x0a81 && _product == 0x0701)
@@ -53,6 +84,50 @@ public:
             RecvCmd recv_cmd = {0};_recv_cmd=recv_cmd;
           }
         }
+  ~LibUSB10Interface() {delete _handler;}
+  // paths of all devices matching vendor and product (see path()),
+  // returns their number
+  static int enumerate( int vendor, int product,
+                        std::vector<std::string>& paths)
+        {
+          paths.clear();
+          libusb_context* ctx;
+          int ret=libusb_init(&ctx);
+          if(ret) return ret;
+          libusb_device** list;
+          ssize_t n=libusb_get_device_list(ctx,&list);
+          for( ssize_t i=0; i<n; ++i)
+          {
+            libusb_device_descriptor d;
+            if(libusb_get_device_descriptor(list[i],&d)==0 &&
+               d.idVendor==vendor && d.idProduct==product)
+                paths.push_back(path(list[i]));
+          }
+          if(n>=0) libusb_free_device_list(list,1);
+          libusb_exit(ctx);
+          return n<0 ? int(n) : int(paths.size());
+        }
+  // bus and port numbers as in sysfs (e.g. 1-1.2), bus and address (e.g.
+  // 1:5) with libusb before 1.0.16
+  static std::string path( libusb_device* dev)
+        {
+          std::ostringstream oss;
+          oss << int(libusb_get_bus_number(dev));
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION>=0x01000102
+          uint8_t ports[7];
+          int n=libusb_get_port_numbers(dev,ports,sizeof(ports));
+          if(n>0)
+          {
+            for( int i=0; i<n; ++i) oss << (i ? '.' : '-') << int(ports[i]);
+            return oss.str();
+          }
+#endif
+          oss << ':' << int(libusb_get_device_address(dev));
+          return oss.str();
+        }
+  // open the device at path instead of the first match, empty for any
+  void setPath( const std::string& path) {_path=path;}
+  const std::string& path() const {return _path;}
   int open()
         {
           int ret=0;
@@ -66,21 +141,327 @@ public:
             std::cerr << "recv commands not initialized" << std::endl;
             return -1;
           }
-          ret=libusb_init(0);
+          ret=libusb_init(&_ctx);
           if(ret)
           {
             std::cerr << "libusb_init failed with code " << ret
                       << " (" << libusb_error_name(ret) << ")" << std::endl;
             return ret;
           }
-          if(_debug) libusb_set_debug(0,2);
-          _dev=libusb_open_device_with_vid_pid(0,_vendor,_product);
+          if(_debug) libusb_set_debug(_ctx,2);
+          ret=openDevice();
+          if(!_init)
+          {
+            libusb_exit(_ctx);
+            _ctx=0;
+            return ret;
+          }
+#ifdef HAVE_LIBUSB_HOTPLUG
+          if(libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+              _hotplug=libusb_hotplug_register_callback(
+                  _ctx,libusb_hotplug_event(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED|
+                                         LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+                  libusb_hotplug_flag(0),_vendor,_product,
+                  LIBUSB_HOTPLUG_MATCH_ANY,&onHotplug,this,
+                  &_hotplugHandle)==LIBUSB_SUCCESS;
+#endif
+          return ret;
+        }
+  int close()
+        {
+          if(!_init && !_lost) return 0;
+          detach();
+          _stream=false;
+#ifdef HAVE_LIBUSB_HOTPLUG
+          if(_hotplug) libusb_hotplug_deregister_callback(_ctx,_hotplugHandle);
+#endif
+          _hotplug=false;
+          int ret=0;
+          if(_dev) ret=closeDevice();
+          _lost=_left=_arrived=false;
+          libusb_exit(_ctx);
+          _ctx=0;
+          return ret;
+        }
+  // true once the device was unplugged or stopped responding, the other
+  // calls fail until recover() succeeded
+  bool lost() const {return _lost;}
+  // reopen and claim a lost device, keeps the context and the descriptors
+  // attached to reactors. Fails fast while the device is absent: after a
+  // hotplug event that it left until it arrived again, otherwise (e.g.
+  // transfer errors of a device still plugged in) after a bus scan.
+  int recover()
+        {
+          if(!_lost) return 0;
+          if(_dev) closeDevice();
+          if(_left ? !_arrived : !present()) return LIBUSB_ERROR_NO_DEVICE;
+          _lost=false;
+          int ret=openDevice();
+          if(ret)
+          {
+            if(_dev) closeDevice();
+            _lost=true;
+            return ret;
+          }
+          _left=_arrived=false;
+          return 0;
+        }
+  // submit msg without waiting for its completion
+  int post( char msg)
+        {
+          TRACE_SCOPE("post");
+          if(_lost) return LIBUSB_ERROR_NO_DEVICE;
+          if(!_dev) return -1;
+          // queue full, wait for the oldest transfer
+          if(pending()==QUEUE_SIZE)
+          {
+            int ret=wait(_queue[_head%QUEUE_SIZE]);
+            int err=retire();
+            if(ret<0) return ret;
+            if(err<0) return err;
+          }
+          Slot& s=_queue[_tail%QUEUE_SIZE];
+          memset(s.buf,0,sizeof(s.buf));
+          libusb_fill_control_setup(s.buf,_send_cmd.RequestType,
+                                    _send_cmd.Request,_send_cmd.Value,
+                                    _send_cmd.Index,BUF_SIZE);
+          s.buf[LIBUSB_CONTROL_SETUP_SIZE]=msg;
+          libusb_fill_control_transfer(s.xfer,_dev,s.buf,&onTransfer,&s,
+                                       _send_cmd.Timeout);
+          int ret=submit(s);
+          if(ret<0)
+          {
+            std::cerr << "libusb_submit_transfer failed with code " << ret
+                      << " (" << libusb_error_name(ret) << ")" << std::endl;
+            return ret;
+          }
+          ++_tail;
+          TRACE_COUNTER("in flight",pending());
+          // status requests don't change the status, a reply on its way
+          // may predate msg
+          if(msg!=_statusMsg) {_cache.invalidate();_stale=_inPending;}
+          return 0;
+        }
+  // submit msg followed by a status request, the reply refreshes the
+  // status cache without anyone waiting for it, a pending request is
+  // followed up once it has been answered (see reapStatus())
+  int postRead( char msg)
+        {
+          int ret=post(msg);
+          if(ret<0) return ret;
+          return requestStatus();
+        }
+  // handle pending events without blocking, returns first transfer error
+  int poll()
+        {
+          TRACE_SCOPE("poll");
+          timeval tv = {0,0};
           if(!_dev)
           {
-            std::cerr << "libusb_open_device_with_vid_pid failed" << std::endl;
-            libusb_exit(0);
-            return -1;
+            // hotplug events of a lost device
+            if(_lost) libusb_handle_events_timeout_completed(_ctx,&tv,0);
+            return _lost ? LIBUSB_ERROR_NO_DEVICE : -1;
           }
+          int ret=lostIf(libusb_handle_events_timeout_completed(_ctx,&tv,0));
+          if(ret<0) return ret;
+          ret=retire();
+          int err=reapStatus();
+          // edges of the stream, also the ones a read() picked up
+          if(_stream && _handler && _cache.valid() &&
+             _cache.status()!=_delivered)
+          {
+            _delivered=_cache.status();
+            _handler->execute();
+          }
+          return ret<0 ? ret : err;
+        }
+  // keep a status request and its interrupt transfer in flight, each
+  // reply renews them, until turned off. read() returns the latest reply
+  // instead of waiting for a fresh one, status changes run the handler.
+  int stream( bool on)
+        {
+          _stream=on;
+          if(!on) return 0;
+          if(!_dev || _lost) return LIBUSB_ERROR_NO_DEVICE;
+          _delivered=_cache.status();
+          return requestStatus();
+        }
+  // executed by poll() when a streamed status differs from the last one,
+  // takes ownership of c
+  void setStatusHandler( Command* c) {delete _handler;_handler=c;}
+  // number of control transfers in flight
+  int pending() const {return _tail-_head;}
+  // let r reap transfers whenever one of the libusb descriptors is ready
+  void attach( Reactor& r)
+        {
+          _reactors.push_back(&r);
+          const libusb_pollfd** fds=libusb_get_pollfds(_ctx);
+          if(fds)
+          {
+            for( const libusb_pollfd** p=fds; *p; ++p)
+                r.add((*p)->fd,(*p)->events,
+                      makeTrigger_0(*this,&LibUSB10Interface::poll));
+            free(fds);
+          }
+          libusb_set_pollfd_notifiers(_ctx,&onPollfdAdded,&onPollfdRemoved,
+                                      this);
+        }
+  void detach()
+        {
+          if(!_ctx) return;
+          libusb_set_pollfd_notifiers(_ctx,0,0,0);
+          const libusb_pollfd** fds=libusb_get_pollfds(_ctx);
+          if(fds)
+          {
+            for( const libusb_pollfd** p=fds; *p; ++p)
+                for( size_t i=0; i<_reactors.size(); ++i)
+                    _reactors[i]->remove((*p)->fd);
+            free(fds);
+          }
+          _reactors.clear();
+        }
+  int send( char msg)
+        {
+          TRACE_SCOPE("send");
+          if(_lost) return LIBUSB_ERROR_NO_DEVICE;
+          if(!_dev) return -1;
+          int ret=post(msg);
+          if(ret<0) return ret;
+          ret=wait(_queue[(_tail-1)%QUEUE_SIZE]);
+          int err=retire();
+          return ret<0 ? ret : err;
+        }
+  // status from the cache, an outstanding request or a new round trip
+  int read( char* status)
+        {
+          TRACE_SCOPE("read");
+          if(_lost) return LIBUSB_ERROR_NO_DEVICE;
+          if(!_dev) return -1;
+          if(!_cache.fresh() && !(_stream && _cache.valid()))
+          {
+            TRACE_SCOPE("read round trip");
+            int ret=0;
+            if(!_inPending) ret=requestStatus();
+            if(ret<0) return ret;
+            // a stale reply is replaced by the follow-up request
+            do
+            {
+              ret=wait(_in);
+              if(!_in.done) return ret;
+              ret=reapStatus();
+            } while( ret>=0 && _inPending && !_cache.valid());
+            // status request has been answered, clean up the queue
+            int err=retire();
+            if(ret<0) return ret;
+            if(err<0) return err;
+          }
+          if(status) *status = _cache.status();
+          return 0;
+        }
+  // time in seconds a status report is reused by read()
+  void setStatusFreshness( double s) {_cache.setFreshness(s);}
+  void setDebug(bool debug) {_debug=debug;}
+private:
+  // own context, the transfers and events of other interfaces (e.g. in a
+  // Fleet) are completed by their threads only
+  libusb_context*       _ctx;
+  libusb_device_handle* _dev;
+  int     _interface;
+  int     _vendor;
+  int     _product;
+  char    _statusMsg;
+  bool    _debug;
+  bool    _init;
+  bool    _lost;
+  // set by the hotplug callback
+  bool    _left;
+  bool    _arrived;
+  bool    _hotplug;
+#ifdef HAVE_LIBUSB_HOTPLUG
+  libusb_hotplug_callback_handle _hotplugHandle;
+#endif
+  std::string _path;
+  
+  SendCmd _send_cmd;
+  RecvCmd _recv_cmd;
+
+  // ring of control transfers, [_head,_tail) are in flight or unretired
+  Slot     _queue[QUEUE_SIZE];
+  unsigned _head;
+  unsigned _tail;
+  Slot     _in;
+  bool     _inPending;
+  // the pending request was sent before the last command
+  bool     _stale;
+  StatusCache<> _cache;
+  bool     _stream;
+  // last status passed to the handler
+  char     _delivered;
+  Command* _handler;
+  std::vector<Reactor*> _reactors;
+
+  // queue a status request and the interrupt transfer for its reply
+  int requestStatus()
+        {
+          if(_inPending) return 0;
+          int ret = post(_statusMsg);
+          if(ret<0) return ret;
+          if( _recv_cmd.Type==XFER_BULK)
+              libusb_fill_bulk_transfer(_in.xfer,_dev,_recv_cmd.Endpoint,
+                                        _in.buf,1,&onTransfer,&_in,
+                                        _recv_cmd.Timeout);
+          else if(_recv_cmd.Type==XFER_INT)
+              libusb_fill_interrupt_transfer(_in.xfer,_dev,_recv_cmd.Endpoint,
+                                             _in.buf,1,&onTransfer,&_in,
+                                             _recv_cmd.Timeout);
+          ret=submit(_in);
+          if(ret<0)
+          {
+            std::cerr << "libusb_submit_transfer failed with code " << ret
+                      << " (" << libusb_error_name(ret) << ")" << std::endl;
+            return ret;
+          }
+          _inPending=true;
+          return 0;
+        }
+  // move a completed status reply into the cache
+  int reapStatus()
+        {
+          if(!_inPending || !_in.done) return 0;
+          _inPending=false;
+          bool stale=_stale;
+          _stale=false;
+          if(lostIf(_in.ret))
+          {
+            std::cerr << "libusb_interrupt_transfer failed with code "
+                      << _in.ret << " (" << libusb_error_name(_in.ret) << ")"
+                      << std::endl;
+            // a timed out reply doesn't end the stream
+            if(_stream && !_lost) requestStatus();
+            return _in.ret;
+          }
+          // the status from before the last command is dropped, the
+          // follow-up request answers for it
+          if(stale) return requestStatus();
+          _cache.store(_in.buf[0]);
+          return _stream ? requestStatus() : 0;
+        }
+
+  // open, claim and test the device, the context is initialized
+  int openDevice()
+        {
+          int ret=0;
+          if(_path.empty())
+          {
+            _dev=libusb_open_device_with_vid_pid(_ctx,_vendor,_product);
+            if(!_dev)
+            {
+              std::cerr << "libusb_open_device_with_vid_pid failed"
+                        << std::endl;
+              return -1;
+            }
+          }
+          else if((ret=openPath())) return ret;
           // try to claim
           if(libusb_kernel_driver_active(_dev,_interface)==1)
           {
@@ -92,7 +473,6 @@ public:
                         << ret << " (" << libusb_error_name(ret) << ")"
                         << std::endl;
               libusb_close(_dev);_dev=0;
-              libusb_exit(0);
               return ret;
             }
           }
@@ -111,7 +491,14 @@ public:
                       << " (" << libusb_error_name(ret) << ")" << std::endl;
             
             libusb_close(_dev);_dev=0;
-            libusb_exit(0);
+            return ret;
+          }
+          ret=allocTransfers();
+          if(ret)
+          {
+            std::cerr << "libusb_alloc_transfer failed" << std::endl;
+            libusb_release_interface(_dev,_interface);
+            libusb_close(_dev);_dev=0;
             return ret;
           }
           _init=true;
@@ -143,74 +530,196 @@ public:
           }
           return ret;
         }
-  int close()
+  // cancel the transfers and give up the device, the context stays
+  int closeDevice()
         {
-          if(!_init) return 0;
+          cancelTransfers();
+          freeTransfers();
+          _init=false;
           int ret = libusb_release_interface(_dev,_interface);
+          // nothing to release on a device that is gone
+          if(ret==LIBUSB_ERROR_NO_DEVICE) ret=0;
           if(ret)
-          {
-            std::cerr << "libusb_release_interface failed with code " << ret
-                      << " (" << libusb_error_name(ret) << ")" << std::endl;
-            return ret;
-          }
+              std::cerr << "libusb_release_interface failed with code " << ret
+                        << " (" << libusb_error_name(ret) << ")" << std::endl;
           libusb_close(_dev);
           _dev=0;
-          libusb_exit(0);
+          _cache.invalidate();
           return ret;
         }
-  int send( char msg)
+  // matching device on the bus, without opening it
+  bool present()
         {
-          if(!_dev) return -1;
-          const int bufsize=8;
-          static unsigned char buf[bufsize];
-          memset(buf,0,bufsize);
-          buf[0]=msg;
-          int ret=libusb_control_transfer(_dev,_send_cmd.RequestType,
-                                          _send_cmd.Request,_send_cmd.Value,
-                                          _send_cmd.Index,buf,bufsize,
-                                          _send_cmd.Timeout);
-          if(ret<0)
+          libusb_device** list;
+          ssize_t n=libusb_get_device_list(_ctx,&list);
+          bool found=false;
+          for( ssize_t i=0; i<n && !found; ++i)
           {
-            std::cerr << "libusb_control_transfer failed with code " << ret
-                      << " (" << libusb_error_name(ret) << ")" << std::endl;
-            return ret;
+            libusb_device_descriptor d;
+            found=libusb_get_device_descriptor(list[i],&d)==0 &&
+                d.idVendor==_vendor && d.idProduct==_product &&
+                (_path.empty() || path(list[i])==_path);
           }
+          if(n>=0) libusb_free_device_list(list,1);
+          return found;
+        }
+#ifdef HAVE_LIBUSB_HOTPLUG
+  static int LIBUSB_CALL onHotplug( libusb_context*, libusb_device* dev,
+                                    libusb_hotplug_event event, void* data)
+        {
+          LibUSB10Interface* self=static_cast<LibUSB10Interface*>(data);
+          if(!self->_path.empty() && path(dev)!=self->_path) return 0;
+          if(event==LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+              self->_arrived=true;
+          else if(self->_dev && libusb_get_device(self->_dev)==dev)
+              self->_lost=self->_left=true;
           return 0;
         }
-  int read( char* status)
+#endif
+  // descriptors of the context come and go with transfers
+  static void LIBUSB_CALL onPollfdAdded( int fd, short events, void* data)
         {
-          if(!_dev) return -1;
-          int ret = send(_statusMsg);
-          if(ret<0) return ret;
-          unsigned char tmp;
-          int actual_xfer=0;
-          if( _recv_cmd.Type==XFER_BULK)
-              ret=libusb_bulk_transfer(_dev,_recv_cmd.Endpoint,&tmp,1,
-                                       &actual_xfer,_recv_cmd.Timeout);
-          else if(_recv_cmd.Type==XFER_INT)
-              ret=libusb_interrupt_transfer(_dev,_recv_cmd.Endpoint,&tmp,1,
-                                            &actual_xfer,_recv_cmd.Timeout);
+          LibUSB10Interface* self=static_cast<LibUSB10Interface*>(data);
+          for( size_t i=0; i<self->_reactors.size(); ++i)
+              self->_reactors[i]->add(
+                  fd,events,makeTrigger_0(*self,&LibUSB10Interface::poll));
+        }
+  static void LIBUSB_CALL onPollfdRemoved( int fd, void* data)
+        {
+          LibUSB10Interface* self=static_cast<LibUSB10Interface*>(data);
+          for( size_t i=0; i<self->_reactors.size(); ++i)
+              self->_reactors[i]->remove(fd);
+        }
+  // open the device at _path
+  int openPath()
+        {
+          libusb_device** list;
+          ssize_t n=libusb_get_device_list(_ctx,&list);
+          if(n<0)
+          {
+            std::cerr << "libusb_get_device_list failed with code " << n
+                      << " (" << libusb_error_name(n) << ")" << std::endl;
+            return n;
+          }
+          int ret=LIBUSB_ERROR_NOT_FOUND;
+          for( ssize_t i=0; i<n; ++i)
+          {
+            libusb_device_descriptor d;
+            if(libusb_get_device_descriptor(list[i],&d)==0 &&
+               d.idVendor==_vendor && d.idProduct==_product &&
+               path(list[i])==_path)
+            {
+              ret=libusb_open(list[i],&_dev);
+              break;
+            }
+          }
+          libusb_free_device_list(list,1);
           if(ret)
           {
-            std::cerr << "libusb_bulk_transfer failed with code " << ret
-                      << " (" << libusb_error_name(ret) << ")" << std::endl;
-            return ret;
+            std::cerr << "Opening device " << _path << " failed with code "
+                      << ret << " (" << libusb_error_name(ret) << ")"
+                      << std::endl;
+            _dev=0;
           }
-          if(status) *status = tmp;
           return ret;
         }
-  void setDebug(bool debug) {_debug=debug;}
-private:
-  libusb_device_handle* _dev;
-  int     _interface;
-  int     _vendor;
-  int     _product;
-  char    _statusMsg;
-  bool    _debug;
-  bool    _init;
-  
-  SendCmd _send_cmd;
-  RecvCmd _recv_cmd;
+  static void LIBUSB_CALL onTransfer( libusb_transfer* xfer)
+        {
+          Slot* s=static_cast<Slot*>(xfer->user_data);
+          switch(xfer->status)
+          {
+          case LIBUSB_TRANSFER_COMPLETED: s->ret=0;                      break;
+          case LIBUSB_TRANSFER_TIMED_OUT: s->ret=LIBUSB_ERROR_TIMEOUT;   break;
+          case LIBUSB_TRANSFER_CANCELLED: s->ret=LIBUSB_ERROR_INTERRUPTED;break;
+          case LIBUSB_TRANSFER_STALL:     s->ret=LIBUSB_ERROR_PIPE;      break;
+          case LIBUSB_TRANSFER_NO_DEVICE: s->ret=LIBUSB_ERROR_NO_DEVICE; break;
+          case LIBUSB_TRANSFER_OVERFLOW:  s->ret=LIBUSB_ERROR_OVERFLOW;  break;
+          default:                        s->ret=LIBUSB_ERROR_IO;        break;
+          }
+          s->done=1;
+        }
+  int submit( Slot& s)
+        {
+          s.done=0;
+          s.ret=0;
+          return lostIf(libusb_submit_transfer(s.xfer));
+        }
+  // errors after which the device has to be reopened
+  int lostIf( int ret)
+        {
+          if(ret==LIBUSB_ERROR_NO_DEVICE || ret==LIBUSB_ERROR_IO) _lost=true;
+          return ret;
+        }
+  // block until s has completed
+  int wait( Slot& s)
+        {
+          while(!s.done)
+          {
+            int ret=libusb_handle_events_completed(_ctx,&s.done);
+            if(ret<0 && ret!=LIBUSB_ERROR_INTERRUPTED) return lostIf(ret);
+          }
+          return lostIf(s.ret);
+        }
+  // pop completed transfers in submission order, returns first error
+  int retire()
+        {
+          int ret=0;
+          while(_head!=_tail && _queue[_head%QUEUE_SIZE].done)
+          {
+            const Slot& s=_queue[_head%QUEUE_SIZE];
+            if(lostIf(s.ret)<0)
+            {
+              std::cerr << "libusb_control_transfer failed with code "
+                        << s.ret << " (" << libusb_error_name(s.ret) << ")"
+                        << std::endl;
+              if(!ret) ret=s.ret;
+            }
+            ++_head;
+          }
+          return ret;
+        }
+  // all or nothing, a partial allocation would leak on every reconnect
+  int allocTransfers()
+        {
+          for( int i=0; i<QUEUE_SIZE; ++i)
+          {
+            if(!(_queue[i].xfer=libusb_alloc_transfer(0)))
+            {
+              freeTransfers();
+              return LIBUSB_ERROR_NO_MEM;
+            }
+            _queue[i].done=1;
+          }
+          if(!(_in.xfer=libusb_alloc_transfer(0)))
+          {
+            freeTransfers();
+            return LIBUSB_ERROR_NO_MEM;
+          }
+          _in.done=1;
+          _head=_tail=0;
+          return 0;
+        }
+  void cancelTransfers()
+        {
+          for( unsigned i=_head; i!=_tail; ++i)
+              libusb_cancel_transfer(_queue[i%QUEUE_SIZE].xfer);
+          if(!_in.done) libusb_cancel_transfer(_in.xfer);
+          for( unsigned i=_head; i!=_tail; ++i)
+              wait(_queue[i%QUEUE_SIZE]);
+          wait(_in);
+          _inPending=_stale=false;
+          _head=_tail;
+        }
+  void freeTransfers()
+        {
+          for( int i=0; i<QUEUE_SIZE; ++i)
+          {
+            libusb_free_transfer(_queue[i].xfer);
+            _queue[i].xfer=0;
+          }
+          libusb_free_transfer(_in.xfer);
+          _in.xfer=0;
+        }
 };
 
 #endif
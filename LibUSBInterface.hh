@@ -4,6 +4,13 @@
 #include <usb.h>
 #include <iostream>
 #include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+
+#include "Common.hh"
+#include "Reactor.hh"
 
 class LibUSBInterface
 {
@@ -26,7 +33,8 @@ class LibUSBInterface
 public:
   LibUSBInterface( int vendor, int product, char statusMsg)
           : _dev(0), _interface(0), _vendor( vendor), _product(product),
-            _statusMsg( statusMsg), _debug(false), _init(false)
+            _statusMsg( statusMsg), _debug(false), _init(false),
+            _lost(false)
         {
           // The hex values passed into the control_msg() method define how the
           // USB interface passes the control byte on to the controller
@@ -53,6 +61,29 @@ public:
             RecvCmd recv_cmd = {0};_recv_cmd=recv_cmd;
           }
         }
+  // paths of all devices matching vendor and product (see path()),
+  // returns their number
+  static int enumerate( int vendor, int product,
+                        std::vector<std::string>& paths)
+        {
+          paths.clear();
+          usb_init();
+          usb_find_busses();
+          usb_find_devices();
+          for( struct usb_bus *bus = usb_get_busses(); bus; bus = bus->next)
+              for( struct usb_device *dev = bus->devices; dev; dev = dev->next)
+                  if (dev->descriptor.idVendor == vendor &&
+                      dev->descriptor.idProduct == product)
+                      paths.push_back(path(dev));
+          return paths.size();
+        }
+  // bus and device file names (e.g. 001:005), libusb-0.1 doesn't know
+  // the ports
+  static std::string path( struct usb_device* dev)
+        {return std::string(dev->bus->dirname)+":"+dev->filename;}
+  // open the device at path instead of the first match, empty for any
+  void setPath( const std::string& path) {_path=path;}
+  const std::string& path() const {return _path;}
   int open()
         {
           if(!_send_cmd.RequestType)
@@ -72,7 +103,8 @@ public:
           for( ; bus && !_dev; bus = bus->next) {
             for( struct usb_device *dev = bus->devices; dev; dev = dev->next) {
               if (dev->descriptor.idVendor == _vendor &&
-                  dev->descriptor.idProduct == _product) {
+                  dev->descriptor.idProduct == _product &&
+                  (_path.empty() || path(dev)==_path)) {
                 _dev = usb_open(dev);
                 if(!_dev)
                 {
@@ -157,19 +189,47 @@ public:
         {
           if(!_init) return 0;
           int ret = usb_release_interface(_dev,_interface);
-          if(ret<0)
+          // nothing to release on a device that is gone
+          if(ret<0 && !_lost)
           {
             std::cerr << "usb_release_interface failed with code " << ret
                       << " (" << strerror(-ret) << ")" << std::endl;
             return ret;
           }
           usb_close(_dev);
-          if(ret<0) return ret;
           _dev=0;
-          return ret;
+          _init=false;
+          _lost=false;
+          return 0;
+        }
+  // true once the device was unplugged or stopped responding, the other
+  // calls fail until recover() succeeded
+  bool lost() const {return _lost;}
+  // reopen and claim a lost device, fails fast while it isn't on the bus
+  int recover()
+        {
+          if(!_lost) return 0;
+          close();
+          _lost=true;
+          std::vector<std::string> paths;
+          enumerate(_vendor,_product,paths);
+          if(paths.empty() || (!_path.empty() &&
+                               std::find(paths.begin(),paths.end(),_path)==
+                               paths.end())) return -ENODEV;
+          _lost=false;
+          int ret=open();
+          if(ret<0)
+          {
+            close();
+            _lost=true;
+            return ret;
+          }
+          return 0;
         }
   int send( char msg)
         {
+          TRACE_SCOPE("send");
+          if(_lost) return -ENODEV;
           if(!_dev) return -1;
           const int bufsize=8;
           static char buf[bufsize];
@@ -178,7 +238,7 @@ public:
           int ret=usb_control_msg(_dev,_send_cmd.RequestType,_send_cmd.Request,
                                   _send_cmd.Value,_send_cmd.Index,buf,bufsize,
                                   _send_cmd.Timeout);
-          if(ret<0)
+          if(lostIf(ret)<0)
           {
             std::cerr << "usb_control_msg failed with code " << ret
                       << " (" << strerror(-ret) << ")" << std::endl;
@@ -186,23 +246,50 @@ public:
           }
           return ret;
         }
+  // libusb-0.1 has no asynchronous interrupt transfers, send immediately
+  int post( char msg) {_cache.invalidate();return send(msg);}
+  // send msg and refresh the status cache
+  int postRead( char msg)
+        {
+          int ret=post(msg);
+          if(ret<0) return ret;
+          return read(0);
+        }
+  int poll() {return 0;}
+  int pending() const {return 0;}
+  // synchronous transfers only, the status is polled
+  int  stream( bool on) {return on ? -ENOSYS : 0;}
+  void setStatusHandler( Command* c) {delete c;}
+  // no pollable descriptors, the event loop falls back to its timeout
+  void attach( Reactor&) {}
+  void detach() {}
   int read( char* status)
         {
+          TRACE_SCOPE("read");
+          if(_lost) return -ENODEV;
           if(!_dev) return -1;
+          if(_cache.fresh())
+          {
+            if( status) *status = _cache.status();
+            return 0;
+          }
           int ret = send(_statusMsg);
           if(ret<0) return ret;
           char tmp;
           ret = usb_interrupt_read(_dev,_recv_cmd.Endpoint,&tmp,1,
                                    _recv_cmd.Timeout);
-          if(ret<0)
+          if(lostIf(ret)<0)
           {
             std::cerr << "usb_interrupt_read failed with code " << ret
                       << " (" << strerror(-ret) << ")" << std::endl;
             return ret;
           }
+          _cache.store(tmp);
           if( status) *status = tmp;
           return ret;
         }
+  // time in seconds a status report is reused by read()
+  void setStatusFreshness( double s) {_cache.setFreshness(s);}
   void setDebug(bool debug) {_debug=debug;}
 private:
   usb_dev_handle* _dev;
@@ -212,9 +299,19 @@ private:
   char            _statusMsg;
   bool            _debug;
   bool            _init;
+  bool            _lost;
+  std::string     _path;
+  StatusCache<>   _cache;
   
   SendCmd _send_cmd;
   RecvCmd _recv_cmd;
+
+  // errors after which the device has to be reopened
+  int lostIf( int ret)
+        {
+          if(ret==-ENODEV || ret==-EIO) _lost=true;
+          return ret;
+        }
 };
 
 #endif
@@ -0,0 +1,202 @@
+#ifndef PLANNER_HH
+#define PLANNER_HH
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// stop of a target sequence, angles in degrees, dwell in seconds
+struct Target
+{
+  Target( double t=0, double p=0, double d=0, bool f=false)
+          : theta(t), phi(p), dwell(d), fire(f) {}
+  double theta;
+  double phi;
+  // time to stay before firing or moving on
+  double dwell;
+  bool   fire;
+};
+
+// visiting order of n targets minimizing the total travel time
+//
+// The costs may be asymmetric, cost[i*(n+1)+j] is the time from target i
+// to target j and index n is the start position, the path doesn't return.
+// Up to EXACT targets the order is optimal (dynamic programming over
+// subsets, O(2^n n^2)), larger sets take the best of a few nearest
+// neighbour orders improved by segment reversals (2-opt) and moving single
+// targets until neither helps, each step costs O(n^2).
+class Planner
+{
+public:
+  enum{EXACT=12};
+  // returns the total time, order gets the target indices
+  static double plan( const std::vector<double>& cost, int n,
+                      std::vector<int>& order)
+        {
+          order.clear();
+          if(n<=0) return 0;
+          if(n<=EXACT) return exact( cost, n, order);
+          return heuristic( cost, n, order);
+        }
+  // total time of visiting order from the start
+  static double length( const std::vector<double>& cost, int n,
+                        const std::vector<int>& order)
+        {
+          double sum=0;
+          int from=n;
+          for( size_t i=0; i<order.size(); ++i)
+          {
+            sum+=cost[from*(n+1)+order[i]];
+            from=order[i];
+          }
+          return sum;
+        }
+private:
+  // Held-Karp: best[s*n+j] is the shortest path from the start through
+  // the set s ending at j
+  static double exact( const std::vector<double>& cost, int n,
+                       std::vector<int>& order)
+        {
+          const double inf=std::numeric_limits<double>::infinity();
+          const int sets=1<<n, m=n+1;
+          std::vector<double> best(size_t(sets)*n,inf);
+          std::vector<signed char> prev(size_t(sets)*n,-1);
+          for( int j=0; j<n; ++j) best[(1<<j)*n+j]=cost[n*m+j];
+          for( int s=1; s<sets; ++s)
+          {
+            for( int j=0; j<n; ++j)
+            {
+              if(!(s&(1<<j))) continue;
+              double b=best[size_t(s)*n+j];
+              if(b==inf) continue;
+              for( int k=0; k<n; ++k)
+              {
+                if(s&(1<<k)) continue;
+                size_t t=size_t(s|(1<<k))*n+k;
+                double c=b+cost[j*m+k];
+                if(c<best[t]) {best[t]=c; prev[t]=j;}
+              }
+            }
+          }
+          int s=sets-1, j=0;
+          for( int k=1; k<n; ++k)
+              if(best[size_t(s)*n+k]<best[size_t(s)*n+j]) j=k;
+          double total=best[size_t(s)*n+j];
+          while( j>=0)
+          {
+            order.push_back(j);
+            int p=prev[size_t(s)*n+j];
+            s&=~(1<<j);
+            j=p;
+          }
+          std::reverse( order.begin(), order.end());
+          return total;
+        }
+  struct ByCost
+  {
+    ByCost( const std::vector<double>& c, int row) : cost(c), from(row) {}
+    bool operator()( int a, int b) const
+        {return cost[from+a]<cost[from+b];}
+    const std::vector<double>& cost;
+    int from;
+  };
+  // best of several descents, starting with each of the STARTS targets
+  // closest to the start position
+  enum{STARTS=8};
+  static double heuristic( const std::vector<double>& cost, int n,
+                           std::vector<int>& order)
+        {
+          const int m=n+1;
+          std::vector<int> first(n);
+          for( int k=0; k<n; ++k) first[k]=k;
+          int starts=std::min(int(STARTS),n);
+          std::partial_sort( first.begin(), first.begin()+starts, first.end(),
+                             ByCost(cost,n*m));
+          double total=std::numeric_limits<double>::infinity();
+          std::vector<int> o;
+          for( int i=0; i<starts; ++i)
+          {
+            double t=descend( cost, n, first[i], o);
+            if(t<total) {total=t; order.swap(o);}
+          }
+          return total;
+        }
+  // nearest neighbour order beginning with first, improved until no
+  // reversal or move of a single target helps
+  static double descend( const std::vector<double>& cost, int n, int first,
+                         std::vector<int>& order)
+        {
+          const int m=n+1;
+          std::vector<bool> done(n,false);
+          order.assign(1,first);
+          done[first]=true;
+          int from=first;
+          for( int i=1; i<n; ++i)
+          {
+            int next=-1;
+            for( int k=0; k<n; ++k)
+                if(!done[k] && (next<0 || cost[from*m+k]<cost[from*m+next]))
+                    next=k;
+            done[next]=true;
+            order.push_back(next);
+            from=next;
+          }
+          // path with the start in front, prefix sums of the costs along
+          // the path and against it price a reversal in constant time
+          std::vector<int> path(1,n);
+          path.insert( path.end(), order.begin(), order.end());
+          std::vector<double> fwd(m), bwd(m);
+          for( bool better=true; better; )
+          {
+            better=false;
+            fwd[0]=bwd[0]=0;
+            for( int k=1; k<m; ++k)
+            {
+              fwd[k]=fwd[k-1]+cost[path[k-1]*m+path[k]];
+              bwd[k]=bwd[k-1]+cost[path[k]*m+path[k-1]];
+            }
+            // reverse path[i..j]
+            for( int i=1; i<m-1 && !better; ++i)
+            {
+              for( int j=i+1; j<m; ++j)
+              {
+                int a=path[i-1], b=path[i], c=path[j];
+                double old=cost[a*m+b]+fwd[j]-fwd[i];
+                double rev=cost[a*m+c]+bwd[j]-bwd[i];
+                if(j<m-1) {
+                  int d=path[j+1];
+                  old+=cost[c*m+d];
+                  rev+=cost[b*m+d];
+                }
+                if(rev<old-1e-9) {
+                  std::reverse( path.begin()+i, path.begin()+j+1);
+                  better=true;
+                  break;
+                }
+              }
+            }
+            if(better) continue;
+            // move path[i] behind path[j]
+            for( int i=1; i<m && !better; ++i)
+            {
+              int a=path[i-1], v=path[i], b= i<m-1 ? path[i+1] : -1;
+              double gain=cost[a*m+v]+(b>=0 ? cost[v*m+b]-cost[a*m+b] : 0);
+              for( int j=0; j<m && !better; ++j)
+              {
+                if(j==i || j==i-1) continue;
+                int c=path[j], d= j<m-1 ? path[j+1] : -1;
+                double loss=cost[c*m+v]+(d>=0 ? cost[v*m+d]-cost[c*m+d] : 0);
+                if(loss<gain-1e-9) {
+                  path.erase( path.begin()+i);
+                  path.insert( path.begin()+(j<i ? j+1 : j), v);
+                  better=true;
+                }
+              }
+            }
+          }
+          order.assign( path.begin()+1, path.end());
+          return length( cost, n, order);
+        }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef POLLER_HH
+#define POLLER_HH
+
+#include <algorithm>
+
+// intervals of the status polls in Launcher::process(): the active one
+// while the launcher moves, the fast one while an endpoint switch is
+// expected, and while idle an interval doubling from the active one up to
+// the idle ceiling
+class Poller
+{
+public:
+  Poller()
+          : _active(0.05), _fast(0.01), _idle(2), _interval(0.05),
+            _count(0) {}
+  void   setActive( double s) {_active=s;_interval=std::min(_interval,s);}
+  void   setFast( double s) {_fast=s;}
+  void   setIdle( double s) {_idle=s;}
+  double active() const {return _active;}
+  double fast() const {return _fast;}
+  double idle() const {return _idle;}
+  // interval until the poll after one that found the launcher active or
+  // idle
+  double next( bool active)
+        {
+          ++_count;
+          _interval = active ? _active : std::min(2*_interval,_idle);
+          return _interval;
+        }
+  // activity between polls, the next idle interval starts over
+  void   reset() {_interval=_active;}
+  double interval() const {return _interval;}
+  // polls so far
+  unsigned long count() const {return _count;}
+private:
+  double _active;
+  double _fast;
+  double _idle;
+  double _interval;
+  unsigned long _count;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef REACTOR_HH
+#define REACTOR_HH
+
+#include "Command.hh"
+#include "Clock.hh"
+#include "Thread.hh"
+
+#include <map>
+#include <vector>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+// event loop multiplexing file descriptors and a timeout, commands
+// registered for a descriptor are executed when it becomes ready
+//
+// wake() may be called from any thread to end a wait early. With a lock
+// set, handlers are executed holding it while waiting happens without.
+class Reactor
+{
+  enum{MAX_EVENTS=16};
+  typedef std::map<int,std::pair<short,Command*> > HandlerMap;
+
+public:
+  Reactor()
+          : _epfd(-1), _tfd(-1), _lock(0), _abort(0)
+        {
+          _wake[0]=_wake[1]=-1;
+          if(pipe(_wake)==0)
+              for( int i=0; i<2; ++i)
+                  fcntl(_wake[i],F_SETFL,fcntl(_wake[i],F_GETFL)|O_NONBLOCK);
+#ifdef __linux__
+          _epfd=epoll_create(MAX_EVENTS);
+          _tfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK);
+          epoll_event ev;
+          ev.events=EPOLLIN;
+          ev.data.fd=_tfd;
+          epoll_ctl(_epfd,EPOLL_CTL_ADD,_tfd,&ev);
+          ev.data.fd=_wake[0];
+          epoll_ctl(_epfd,EPOLL_CTL_ADD,_wake[0],&ev);
+#endif
+        }
+  ~Reactor()
+        {
+          for( HandlerMap::const_iterator it=_handlers.begin();
+               it!=_handlers.end(); ++it)
+              delete it->second.second;
+          _handlers.clear();
+#ifdef __linux__
+          ::close(_tfd);
+          ::close(_epfd);
+#endif
+          ::close(_wake[0]);
+          ::close(_wake[1]);
+        }
+  // execute c whenever fd is ready for events (POLLIN/POLLOUT),
+  // takes ownership of c
+  int add( int fd, short events, Command* c)
+        {
+          remove(fd);
+          _handlers[fd]=std::make_pair(events,c);
+#ifdef __linux__
+          epoll_event ev;
+          ev.events=events;
+          ev.data.fd=fd;
+          if(epoll_ctl(_epfd,EPOLL_CTL_ADD,fd,&ev)<0) return -errno;
+#endif
+          return 0;
+        }
+  int remove( int fd)
+        {
+          HandlerMap::iterator it=_handlers.find(fd);
+          if(it==_handlers.end()) return 0;
+          delete it->second.second;
+          _handlers.erase(it);
+#ifdef __linux__
+          epoll_event ev;
+          if(epoll_ctl(_epfd,EPOLL_CTL_DEL,fd,&ev)<0) return -errno;
+#endif
+          return 0;
+        }
+  // wait at most timeout seconds for events and dispatch them,
+  // returns number of executed handlers
+  int wait( double timeout) {return run(timeout,false);}
+  // wait for events until the absolute CLOCK_MONOTONIC time deadline
+  int waitAbs( double deadline) {return run(deadline,true);}
+  // wait for events until deadline on Clock, a virtual clock is
+  // advanced to the deadline after dispatching whatever is ready
+  template<class Clock>
+  int waitUntil( double deadline)
+        {
+          if(Clock::realtime) return waitAbs(deadline);
+          double dt=deadline-Clock::now();
+          int ret=wait(0);
+          Clock::sleep(dt);
+          return ret;
+        }
+  // dispatch events until deadline has passed on Clock or the abort
+  // flag is raised
+  template<class Clock>
+  void runUntil( double deadline)
+        {
+          while( !aborted() && Clock::now() < deadline)
+              waitUntil<Clock>(deadline);
+        }
+  // descriptor that is readable while events are pending, for nesting
+  // the reactor in another event loop (-1 without epoll)
+  int fd() const {return _epfd;}
+  // end the current or next wait, safe to call from any thread
+  void wake()
+        {
+          char c=0;
+          if(::write(_wake[1],&c,1)<0) {}
+        }
+  // execute handlers with m locked
+  void setLock( Mutex* m) {_lock=m;}
+  // runUntil() returns early while *flag is set, 0 disables
+  void setAbort( const int* flag) {_abort=flag;}
+  bool aborted() const
+        {
+          return _abort && __atomic_load_n(_abort,__ATOMIC_ACQUIRE);
+        }
+private:
+  Reactor( const Reactor&);
+  Reactor& operator=( const Reactor&);
+
+  int        _epfd;
+  int        _tfd;
+  int        _wake[2];
+  Mutex*     _lock;
+  const int* _abort;
+  HandlerMap _handlers;
+
+  void drain()
+        {
+          char buf[64];
+          while( ::read(_wake[0],buf,sizeof(buf))>0);
+        }
+
+  int run( double t, bool absolute)
+        {
+#ifdef __linux__
+          // use the timerfd for sub-millisecond timeouts
+          int ms=-1;
+          if(!absolute && t<=0) ms=0;
+          else
+          {
+            if(t<0) t=0;
+            itimerspec its = {{0,0},{0,0}};
+            its.it_value.tv_sec  = time_t(t);
+            its.it_value.tv_nsec = long((t-its.it_value.tv_sec)*1e9);
+            if(!its.it_value.tv_sec && !its.it_value.tv_nsec)
+                its.it_value.tv_nsec=1;
+            timerfd_settime(_tfd,absolute ? TFD_TIMER_ABSTIME : 0,&its,0);
+          }
+          epoll_event ev[MAX_EVENTS];
+          int n=epoll_wait(_epfd,ev,MAX_EVENTS,ms);
+          if(n<0) return errno==EINTR ? 0 : -errno;
+          std::vector<int> ready;
+          for( int i=0; i<n; ++i)
+          {
+            if(ev[i].data.fd==_tfd)
+            {
+              uint64_t expired;
+              if(::read(_tfd,&expired,sizeof(expired))<0) {}
+              continue;
+            }
+            if(ev[i].data.fd==_wake[0]) {drain();continue;}
+            ready.push_back(ev[i].data.fd);
+          }
+#else
+          if(absolute) t-=SystemClock::now();
+          if(t<0) t=0;
+          std::vector<pollfd> fds;
+          pollfd w = {_wake[0],POLLIN,0};
+          fds.push_back(w);
+          for( HandlerMap::const_iterator it=_handlers.begin();
+               it!=_handlers.end(); ++it)
+          {
+            pollfd p = {it->first,it->second.first,0};
+            fds.push_back(p);
+          }
+          int n=::poll(fds.size() ? &fds[0] : 0,fds.size(),
+                       int(t*1e3+0.999));
+          if(n<0) return errno==EINTR ? 0 : -errno;
+          std::vector<int> ready;
+          if(fds[0].revents) drain();
+          for( size_t i=1; i<fds.size(); ++i)
+              if(fds[i].revents) ready.push_back(fds[i].fd);
+#endif
+          // handlers may add or remove descriptors, look each one up again
+          if(_lock && ready.size()) _lock->lock();
+          int ret=0;
+          for( size_t i=0; i<ready.size(); ++i)
+          {
+            HandlerMap::const_iterator it=_handlers.find(ready[i]);
+            if(it==_handlers.end()) continue;
+            it->second.second->execute();
+            ++ret;
+          }
+          if(_lock && ready.size()) _lock->unlock();
+          return ret;
+        }
+};
+
+#endif
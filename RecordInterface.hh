@@ -0,0 +1,81 @@
+#ifndef RECORDINTERFACE_HH
+#define RECORDINTERFACE_HH
+
+#include <string>
+#include <vector>
+
+#include "Clock.hh"
+#include "Reactor.hh"
+#include "TrafficLog.hh"
+
+// MsgIface wrapper logging every call to the wrapped interface with its
+// message or status, return code and time (see TrafficLog.hh), the log is
+// played back by ReplayInterface
+//
+// Without a log the calls are passed through. poll() and lost() aren't
+// logged, they are called at the rate of the main loop and carry no data,
+// the failed calls and recover() attempts around a lost device are.
+template<class MsgIface, class Clock=SystemClock>
+class RecordInterface
+{
+public:
+  RecordInterface( int vendor, int product, char statusMsg)
+          : _mi(vendor,product,statusMsg), _start(0) {}
+  ~RecordInterface() {_log.close();}
+  static int enumerate( int vendor, int product,
+                        std::vector<std::string>& paths)
+        {return MsgIface::enumerate(vendor,product,paths);}
+  void setPath( const std::string& path) {_mi.setPath(path);}
+  const std::string& path() const {return _mi.path();}
+  // start logging to path, replacing its contents
+  int record( const std::string& path)
+        {
+          int ret=_log.open(path);
+          _start=Clock::now();
+          return ret;
+        }
+  int open()  {return logged(TrafficRecord::OPEN,0,_mi.open());}
+  int close()
+        {
+          int ret=logged(TrafficRecord::CLOSE,0,_mi.close());
+          _log.flush();
+          return ret;
+        }
+  int post( char msg)
+        {return logged(TrafficRecord::POST,msg,_mi.post(msg));}
+  int postRead( char msg)
+        {return logged(TrafficRecord::POST_READ,msg,_mi.postRead(msg));}
+  int send( char msg)
+        {return logged(TrafficRecord::SEND,msg,_mi.send(msg));}
+  int read( char* status)
+        {
+          char s=0;
+          int ret=_mi.read(&s);
+          if(status) *status=s;
+          return logged(TrafficRecord::READ,s,ret);
+        }
+  bool lost() const {return _mi.lost();}
+  int  recover() {return logged(TrafficRecord::RECOVER,0,_mi.recover());}
+  int  poll() {return _mi.poll();}
+  int  pending() const {return _mi.pending();}
+  int  stream( bool on) {return _mi.stream(on);}
+  void setStatusHandler( Command* c) {_mi.setStatusHandler(c);}
+  void setStatusFreshness( double s) {_mi.setStatusFreshness(s);}
+  void attach( Reactor& r) {_mi.attach(r);}
+  void detach() {_mi.detach();}
+  void setDebug(bool debug) {_mi.setDebug(debug);}
+  // wrapped interface
+  MsgIface& device() {return _mi;}
+private:
+  MsgIface      _mi;
+  TrafficWriter _log;
+  double        _start;
+
+  int logged( int op, char arg, int ret)
+        {
+          if(_log.isOpen()) _log.add(Clock::now()-_start,op,arg,ret);
+          return ret;
+        }
+};
+
+#endif
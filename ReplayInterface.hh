@@ -0,0 +1,181 @@
+#ifndef REPLAYINTERFACE_HH
+#define REPLAYINTERFACE_HH
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include "Clock.hh"
+#include "Reactor.hh"
+#include "TrafficLog.hh"
+
+// MsgIface serving a log written by RecordInterface, can replace the USB
+// interfaces in Launcher for reproducing a recorded session without
+// hardware
+//
+// Messages and status reads are matched in order against the logged ones
+// and get the logged return codes and status, a message that differs from
+// the log counts as a divergence. In real time calls return when the
+// logged ones completed and reads skip the reports that are already due,
+// so the same inputs at a different pace see the same device. Otherwise
+// the log is served as fast as it is read, with VirtualClock in Launcher
+// both are deterministic.
+template<class Clock=SystemClock>
+class ReplayInterface
+{
+public:
+  ReplayInterface( int, int, char)
+          : _debug(false), _init(false), _realtime(true), _start(0),
+            _writes(0), _reads(0), _diverged(0) {}
+  void setLog( const std::string& path) {_path=path;}
+  // keep the logged timing (default) or return immediately
+  void setRealtime( bool realtime) {_realtime=realtime;}
+  int open()
+        {
+          if(!_log.isOpen())
+          {
+            int ret=_log.open(_path);
+            if(ret<0)
+            {
+              std::cerr << "Opening replay log " << _path
+                        << " failed with code " << ret << " ("
+                        << strerror(-ret) << ")" << std::endl;
+              return ret;
+            }
+          }
+          // next session of the log
+          size_t i=std::max(_writes,_reads);
+          while( i<_log.size() && _log[i].op!=TrafficRecord::OPEN) ++i;
+          if(i==_log.size()) return exhausted();
+          const TrafficRecord& r=_log[i];
+          _start=Clock::now()-r.time;
+          _writes=_reads=i+1;
+          _init= r.ret==0;
+          return r.ret;
+        }
+  // skips to the end of the session
+  int close()
+        {
+          if(!_init) return 0;
+          _init=false;
+          size_t i=std::max(_writes,_reads);
+          while( i<_log.size() && _log[i].op!=TrafficRecord::OPEN &&
+                 _log[i].op!=TrafficRecord::CLOSE) ++i;
+          if(i==_log.size() || _log[i].op!=TrafficRecord::CLOSE) return 0;
+          _writes=_reads=i+1;
+          return _log[i].ret;
+        }
+  int post( char msg)     {return write(TrafficRecord::POST,msg);}
+  int postRead( char msg) {return write(TrafficRecord::POST_READ,msg);}
+  int send( char msg)     {return write(TrafficRecord::SEND,msg);}
+  int read( char* status)
+        {
+          if(!_init) return -1;
+          size_t i=next(_reads,isRead);
+          if(i==_log.size()) return exhausted();
+          if(_realtime)
+          {
+            // the latest report that is due
+            double now=Clock::now()-_start;
+            size_t j;
+            while( (j=next(i+1,isRead))<_log.size() && _log[j].time<=now)
+                i=j;
+          }
+          const TrafficRecord& r=serve(i);
+          _reads=i+1;
+          if(status) *status=r.arg;
+          return r.ret;
+        }
+  // the recorded session lost the device here, recover() serves the
+  // logged attempts at reopening it
+  bool lost() const
+        {
+          size_t i=position();
+          return _init && i<_log.size() && _log[i].op==TrafficRecord::RECOVER;
+        }
+  int recover()
+        {
+          if(!_init) return -1;
+          size_t i=next(position(),isRecover);
+          if(i==_log.size()) return exhausted();
+          const TrafficRecord& r=serve(i);
+          _writes=_reads=i+1;
+          return r.ret;
+        }
+  int  poll() {return _init ? 0 : -1;}
+  int  pending() const {return 0;}
+  // the logged reads are served in order, a stream would skip them
+  int  stream( bool on) {return on ? -ENOSYS : 0;}
+  void setStatusHandler( Command* c) {delete c;}
+  void setStatusFreshness( double) {}
+  // no descriptors, the event loop falls back to its timeout
+  void attach( Reactor&) {}
+  void detach() {}
+  void setDebug(bool debug) {_debug=debug;}
+  // messages that differed from the log
+  size_t diverged() const {return _diverged;}
+  // records of the log served so far
+  size_t position() const {return std::max(_writes,_reads);}
+  size_t size() const {return _log.size();}
+private:
+  std::string   _path;
+  TrafficReader _log;
+  bool   _debug;
+  bool   _init;
+  bool   _realtime;
+  double _start;
+  // positions of the next message and status read
+  size_t _writes;
+  size_t _reads;
+  size_t _diverged;
+
+  static bool isRead( int op) {return op==TrafficRecord::READ;}
+  static bool isRecover( int op) {return op==TrafficRecord::RECOVER;}
+  static bool isWrite( int op)
+        {
+          return op==TrafficRecord::POST || op==TrafficRecord::POST_READ ||
+              op==TrafficRecord::SEND;
+        }
+  // first record from i on matching op before the end of the session
+  size_t next( size_t i, bool (*match)(int)) const
+        {
+          for( ; i<_log.size(); ++i)
+          {
+            int op=_log[i].op;
+            if(op==TrafficRecord::OPEN || op==TrafficRecord::CLOSE) break;
+            if(match(op)) return i;
+          }
+          return _log.size();
+        }
+  int write( int op, char msg)
+        {
+          if(!_init) return -1;
+          size_t i=next(_writes,isWrite);
+          if(i==_log.size()) return exhausted();
+          const TrafficRecord& r=serve(i);
+          _writes=i+1;
+          if(r.op!=op || r.arg!=msg)
+          {
+            ++_diverged;
+            if(_debug) std::cerr << "Replay diverged at record " << i
+                                 << ": sent " << int(msg) << ", logged "
+                                 << int(r.arg) << std::endl;
+          }
+          return r.ret;
+        }
+  const TrafficRecord& serve( size_t i)
+        {
+          if(_realtime) Clock::sleepUntil(_start+_log[i].time);
+          return _log[i];
+        }
+  int exhausted()
+        {
+          if(_debug) std::cerr << "Replay log " << _path << " ended"
+                               << std::endl;
+          return -ENODEV;
+        }
+};
+
+#endif
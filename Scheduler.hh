@@ -0,0 +1,77 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include "Reactor.hh"
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// sleeps until absolute deadlines on Clock while the reactor keeps
+// dispatching events, and keeps statistics of how late the scheduled
+// commands were submitted and took effect
+template<class Clock>
+class Scheduler
+{
+public:
+  Scheduler( Reactor& r)
+          : _reactor(r), _margin(0.0005) {}
+  // dispatch events until shortly before deadline, then sleep for the
+  // rest without the epoll round trip, returns false if the reactor
+  // was aborted before
+  bool sleepUntil( double deadline)
+        {
+          TRACE_SCOPE("sleep");
+#ifdef __linux__
+          // default timer slack of 50us would dominate the error, the
+          // setting is per thread and moves may run on the executor
+          prctl( PR_SET_TIMERSLACK, 1);
+#endif
+          _reactor.template runUntil<Clock>(deadline-_margin);
+          if(_reactor.aborted()) return false;
+          Clock::sleepUntil(deadline);
+          return true;
+        }
+  // record how late the command scheduled for deadline was submitted, call
+  // right after post() returned. Asynchronous transfers complete later, the
+  // delay doesn't include the time on the bus.
+  void record( double deadline) {_submit.add( Clock::now()-deadline);}
+  // record how late the command scheduled for deadline took effect, call
+  // when the first status reply sent after it arrived. An upper bound of
+  // the overshoot of the move, including the transfers and the device.
+  void recordOvershoot( double deadline)
+        {_overshoot.add( Clock::now()-deadline);}
+  // time before a deadline to stop dispatching events
+  void   setMargin( double margin) {_margin=margin;}
+  int    count() const {return _submit.count;}
+  double lastSubmitDelay() const {return _submit.last;}
+  double meanSubmitDelay() const {return _submit.mean();}
+  double maxSubmitDelay()  const {return _submit.max;}
+  int    overshoots() const {return _overshoot.count;}
+  double lastOvershoot() const {return _overshoot.last;}
+  double meanOvershoot() const {return _overshoot.mean();}
+  double maxOvershoot()  const {return _overshoot.max;}
+private:
+  struct Lateness
+  {
+    Lateness() : count(0), last(0), sum(0), max(0) {}
+    void   add( double t)
+          {
+            last=t;
+            sum+=t;
+            if(!count || t>max) max=t;
+            ++count;
+          }
+    double mean() const {return count ? sum/count : 0;}
+    int    count;
+    double last;
+    double sum;
+    double max;
+  };
+  Reactor& _reactor;
+  double   _margin;
+  Lateness _submit;
+  Lateness _overshoot;
+};
+
+#endif
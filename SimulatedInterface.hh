@@ -0,0 +1,385 @@
+#ifndef SIMULATEDINTERFACE_HH
+#define SIMULATEDINTERFACE_HH
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <utility>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "Common.hh"
+#include "Clock.hh"
+#include "Reactor.hh"
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+// software model of the launcher, can replace the USB interfaces in
+// Launcher for testing and benchmarking without hardware
+//
+// Positions are fractions of the travel range: theta runs from 0 (up
+// endpoint) to 1 (down endpoint), phi from 0 (right endpoint) to 1 (left
+// endpoint). Commands take effect after the simulated transfer latency.
+// Motion is integrated as progress in time, the profile maps it to the
+// position for speeds that vary over the range.
+template<class Clock=SystemClock>
+class SimulatedInterface
+{
+  typedef std::deque<std::pair<double,char> > CmdQueue;
+
+public:
+  SimulatedInterface( int vendor, int product, char statusMsg)
+          : _vendor(vendor), _product(product), _statusMsg(statusMsg),
+            _debug(false), _init(false), _plugged(true), _lost(false),
+            _profile(0),
+            _theta(0.5), _phi(0.5), _current(MSG_NONE),
+            _fireStart(-1), _shots(0), _last(0), _seed(1), _statusDue(-1),
+            _tfd(-1), _stale(false), _stream(false), _delivered(0),
+            _handler(0)
+        {
+          // defaults measured with Launcher::calibrate
+          setSpeeds( 2.95986, 2.76801, 19.5367, 19.857);
+          setLatency( 0.001, 0.0005);
+          setFireCycle( 5.5);
+        }
+  ~SimulatedInterface()
+        {
+          if(_tfd>=0) ::close(_tfd);
+          delete _handler;
+        }
+  // paths sim-0, sim-1, ... of setDevices() launchers
+  static int enumerate( int, int, std::vector<std::string>& paths)
+        {
+          paths.clear();
+          for( int i=0; i<devices(); ++i)
+          {
+            std::ostringstream oss;
+            oss << "sim-" << i;
+            paths.push_back(oss.str());
+          }
+          return paths.size();
+        }
+  // number of launchers enumerate() reports, 1 by default
+  static void setDevices( int n) {devices()=n;}
+  void setPath( const std::string& path) {_path=path;}
+  const std::string& path() const {return _path;}
+  int open()
+        {
+          if(_debug) std::cerr << "Opening simulated launcher " << _path
+                               << std::endl;
+          if(!_plugged) return -ENODEV;
+          _last=Clock::now();
+          _init=true;
+          _lost=false;
+          return 0;
+        }
+  int close()
+        {
+          if(!_init) return 0;
+          _queue.clear();
+          _statusDue=-1;
+          _stale=false;
+          _stream=false;
+          _init=false;
+          return 0;
+        }
+  bool lost() const {return _lost;}
+  // fails while unplugged
+  int recover()
+        {
+          if(!_lost) return 0;
+          if(!_plugged) return -ENODEV;
+          _last=Clock::now();
+          _lost=false;
+          return 0;
+        }
+  // queue msg, it reaches the device after one transfer latency
+  int post( char msg)
+        {
+          if(_lost) return -ENODEV;
+          if(!_init) return -1;
+          _queue.push_back(std::make_pair(Clock::now()+transferTime(),msg));
+          // status requests don't change the status, a reply on its way
+          // may predate msg
+          if(msg!=_statusMsg) {_cache.invalidate();_stale=_statusDue>=0;}
+          return 0;
+        }
+  // queue msg and a status request, the reply refreshes the cache
+  int postRead( char msg)
+        {
+          int ret=post(msg);
+          if(ret<0) return ret;
+          requestStatus();
+          return 0;
+        }
+  int poll()
+        {
+          if(_lost) return -ENODEV;
+          if(!_init) return -1;
+#ifdef __linux__
+          uint64_t expired;
+          if(_tfd>=0 && ::read(_tfd,&expired,sizeof(expired))<0) {}
+#endif
+          advance();
+          if(_statusDue>=0 && Clock::now()>=_statusDue) reapStatus();
+          if(_stream && _handler && _cache.valid() &&
+             _cache.status()!=_delivered)
+          {
+            _delivered=_cache.status();
+            _handler->execute();
+          }
+          return 0;
+        }
+  // keep a status request in flight, each reply renews it, until turned
+  // off (see LibUSB10Interface::stream()), the replies are delivered
+  // through a timer descriptor in the attached reactors
+  int stream( bool on)
+        {
+          _stream=on;
+          if(!on) return 0;
+          if(_lost) return -ENODEV;
+          if(_tfd<0 || !_init) {_stream=false;return -ENOSYS;}
+          _delivered=_cache.status();
+          requestStatus();
+          arm(_statusDue);
+          return 0;
+        }
+  void setStatusHandler( Command* c) {delete _handler;_handler=c;}
+  int pending() const {return _queue.size();}
+  int send( char msg)
+        {
+          TRACE_SCOPE("send");
+          int ret=post(msg);
+          if(ret<0) return ret;
+          sleepUntil(_queue.back().first);
+          return 0;
+        }
+  // status from the cache, an outstanding request or a new round trip
+  int read( char* status)
+        {
+          TRACE_SCOPE("read");
+          if(_lost) return -ENODEV;
+          if(!_init) return -1;
+          // a streamed reply can be due before the timer fired, always on
+          // a virtual clock
+          if(_statusDue>=0 && Clock::now()>=_statusDue)
+          {
+            advance();
+            reapStatus();
+          }
+          // a stale reply is replaced by the follow-up request
+          while(!_cache.fresh() && !(_stream && _cache.valid()))
+          {
+            if(_statusDue<0) requestStatus();
+            sleepUntil(_statusDue);
+            reapStatus();
+            if(_cache.valid()) break;
+          }
+          if(status) *status=_cache.status();
+          return 0;
+        }
+  void setStatusFreshness( double s) {_cache.setFreshness(s);}
+  // transfers are completed by poll(), streamed replies wake r
+  void attach( Reactor& r)
+        {
+#ifdef __linux__
+          if(_tfd<0) _tfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK);
+          if(_tfd<0) return;
+          r.add(_tfd,POLLIN,makeTrigger_0(*this,&SimulatedInterface::poll));
+          _reactors.push_back(&r);
+#endif
+        }
+  void detach()
+        {
+          for( size_t i=0; i<_reactors.size(); ++i) _reactors[i]->remove(_tfd);
+          _reactors.clear();
+        }
+  void setDebug(bool debug) {_debug=debug;}
+
+  // model parameters
+  // time in seconds for moving between the endpoints of each direction
+  void setSpeeds( double thetaPos, double thetaNeg,
+                  double phiPos, double phiNeg)
+        {
+          _thetaPos=thetaPos; _thetaNeg=thetaNeg;
+          _phiPos=phiPos;     _phiNeg=phiNeg;
+        }
+  // one-way transfer latency plus uniformly distributed jitter
+  void setLatency( double latency, double jitter)
+        {_latency=latency;_jitter=jitter;}
+  void setSeed( unsigned seed) {_seed=seed;}
+  // time until the fire status bit is set after MSG_FIRE
+  void setFireCycle( double t) {_fireCycle=t;}
+  // speed at the endpoints relative to the mean speed is 1+k, in the
+  // middle 1-k, -1<k<1, 0 is constant speed
+  void setProfile( double k) {advance();_profile=k;}
+  void setPosition( double theta, double phi)
+        {advance();_theta=progress(clamp(theta));_phi=progress(clamp(phi));}
+  // pull the cable: the motors stop, transfers in flight are lost and
+  // calls fail until plug() and recover()
+  void unplug()
+        {
+          advance();
+          _current=MSG_NONE;
+          _queue.clear();
+          _statusDue=-1;
+          _stale=false;
+          _stream=false;
+          _cache.invalidate();
+          _plugged=false;
+          _lost=true;
+        }
+  void plug() {_plugged=true;}
+  double thetaFraction() {advance();return position(_theta);}
+  double phiFraction()   {advance();return position(_phi);}
+  char   current() const {return _current;}
+  int    shots()   const {return _shots;}
+
+private:
+  int     _vendor;
+  int     _product;
+  char    _statusMsg;
+  bool    _debug;
+  bool    _init;
+  bool    _plugged;
+  bool    _lost;
+  double  _profile;
+  std::string _path;
+
+  double   _thetaPos;
+  double   _thetaNeg;
+  double   _phiPos;
+  double   _phiNeg;
+  double   _latency;
+  double   _jitter;
+  double   _fireCycle;
+  double   _theta;
+  double   _phi;
+  char     _current;
+  double   _fireStart;
+  int      _shots;
+  double   _last;
+  unsigned _seed;
+  CmdQueue _queue;
+  double   _statusDue;
+  StatusCache<Clock> _cache;
+  // timer expiring when a streamed reply is due
+  int      _tfd;
+  std::vector<Reactor*> _reactors;
+  // the pending request was sent before the last command
+  bool     _stale;
+  bool     _stream;
+  char     _delivered;
+  Command* _handler;
+
+  static int& devices() {static int n=1; return n;}
+  static double clamp( double x) {return x<0 ? 0 : (x>1 ? 1 : x);}
+  double position( double s) const
+        {return s+_profile*std::sin(2*M_PI*s)/(2*M_PI);}
+  double progress( double u) const
+        {
+          double lo=0, hi=1;
+          for( int i=0; i<50; ++i)
+          {
+            double m=(lo+hi)/2;
+            if(position(m)<u) lo=m;
+            else              hi=m;
+          }
+          return (lo+hi)/2;
+        }
+  double transferTime()
+        {
+          return _latency + _jitter*rand_r(&_seed)/(double(RAND_MAX)+1);
+        }
+  // the reply arrives one transfer after the request
+  void requestStatus()
+        {
+          if(_statusDue>=0) return;
+          post(_statusMsg);
+          _statusDue=_queue.back().first+transferTime();
+          if(_stream) arm(_statusDue);
+        }
+  void reapStatus()
+        {
+          _statusDue=-1;
+          // the status from before the last command is dropped, the
+          // follow-up request answers for it
+          if(_stale) {_stale=false;requestStatus();return;}
+          _cache.store(status());
+          if(_stream) requestStatus();
+        }
+  // expire the timer at t on Clock
+  void arm( double t)
+        {
+#ifdef __linux__
+          double dt=std::max(t-Clock::now(),1e-9);
+          itimerspec its = {{0,0},{0,0}};
+          its.it_value.tv_sec  = time_t(dt);
+          its.it_value.tv_nsec = long((dt-its.it_value.tv_sec)*1e9);
+          if(!its.it_value.tv_sec && !its.it_value.tv_nsec)
+              its.it_value.tv_nsec=1;
+          timerfd_settime(_tfd,0,&its,0);
+#endif
+        }
+  void sleepUntil( double t)
+        {
+          Clock::sleep(t-Clock::now());
+          advance();
+        }
+  // integrate motion up to now, applying queued commands on the way
+  void advance()
+        {
+          double now=Clock::now();
+          while( !_queue.empty() && _queue.front().first<=now)
+          {
+            integrate(_queue.front().first);
+            apply(_queue.front().second);
+            _queue.pop_front();
+          }
+          integrate(now);
+        }
+  void integrate( double t)
+        {
+          double dt=t-_last;
+          if(dt<=0) return;
+          _last=t;
+          if     (_current & MSG_DOWN)  _theta=clamp(_theta+dt/_thetaPos);
+          else if(_current & MSG_UP)    _theta=clamp(_theta-dt/_thetaNeg);
+          if     (_current & MSG_LEFT)  _phi  =clamp(_phi  +dt/_phiPos);
+          else if(_current & MSG_RIGHT) _phi  =clamp(_phi  -dt/_phiNeg);
+        }
+  void apply( char msg)
+        {
+          if(_debug) std::cerr << "Simulated launcher got " << int(msg)
+                               << std::endl;
+          if(msg==_statusMsg || msg==MSG_NONE) return;
+          if(msg & MSG_FIRE)
+          {
+            if(!(_current & MSG_FIRE)) {_fireStart=_last;++_shots;}
+          }
+          else _fireStart=-1;
+          _current = (msg & MSG_STOP) ? char(MSG_NONE) : msg;
+        }
+  char status() const
+        {
+          // reports carry the request bit, Launcher::process() treats an
+          // empty report as a dead device
+          char s=_statusMsg;
+          if(_theta<=0) s|=MSG_UP;
+          if(_theta>=1) s|=MSG_DOWN;
+          if(_phi<=0)   s|=MSG_RIGHT;
+          if(_phi>=1)   s|=MSG_LEFT;
+          if(_fireStart>=0 && _last-_fireStart>=_fireCycle) s|=MSG_FIRE;
+          return s;
+        }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef SOCKETINTERFACE_HH
+#define SOCKETINTERFACE_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "Common.hh"
+#include "Command.hh"
+#include "ActionTable.hh"
+#include "Reactor.hh"
+
+// user interface for running headless, clients connect to a Unix domain
+// socket (SOCK_SEQPACKET, one frame per message) and send requests
+//
+// All frames are 16 bytes, integers in network byte order:
+//   uint8 op, uint8 arg, uint16 seq, int32 code, int32 a, int32 b
+// Requests set op, arg, seq and the arguments a and b, angles are in
+// millidegrees and times in milliseconds:
+//   MOVE      arg: direction bits (MSG_*), starts moving
+//   STOP      cancels running moves and stops
+//   MOVEABS   a: theta, b: phi
+//   MOVEREL   a: theta, b: phi
+//   FIRE      a: timeout, 0 stops after the fire status bit
+//   HOME      goes to the upper-right endpoints
+//   CALIBRATE runs the calibration pattern
+//   STATUS    reply carries the position in a and b
+//   SUBSCRIBE arg: 1 to receive EVENT frames, 0 to stop
+//   KEY       arg: executes the action bound to that key
+// Every request is answered with op|REPLY, the same seq, the current
+// status bits in arg and the return value in code. Blocking requests are
+// queued on the launcher's executor and answered immediately.
+// Subscribers get an EVENT frame with the status bits in arg and the
+// current command in a whenever either changes.
+class SocketInterface
+{
+  struct Client {bool subscribed;};
+  typedef std::map<int,Client> ClientMap;
+
+public:
+  enum
+  {
+    OP_MOVE=1, OP_STOP, OP_MOVEABS, OP_MOVEREL, OP_FIRE, OP_HOME,
+    OP_CALIBRATE, OP_STATUS, OP_SUBSCRIBE, OP_KEY,
+    OP_EVENT=0x7f, OP_REPLY=0x80
+  };
+  struct Frame
+  {
+    uint8_t op;
+    uint8_t arg;
+    uint16_t seq;
+    int32_t code;
+    int32_t a;
+    int32_t b;
+  };
+
+  SocketInterface( const std::string& path="/tmp/rocketlauncher.sock")
+          : _path(path), _listen(-1), _debug(false), _status(0),
+            _current(MSG_NONE), _sentStatus(-1), _sentCurrent(-1),
+            _handler(0), _replied(false)
+        {memset(&_request,0,sizeof(_request));}
+  ~SocketInterface() {close(); resetActions(); delete _handler;}
+
+  void setPath( const std::string& path) {_path=path;}
+  // executed for all launcher requests, see SocketControl below
+  void setHandler( Command* c) {delete _handler; _handler=c;}
+  // request being handled
+  const Frame& request() const {return _request;}
+  // answer the current request from the handler
+  void reply( int code, int a=0, int b=0)
+        {
+          Frame f;
+          f.op=_request.op|OP_REPLY; f.arg=_status; f.seq=_request.seq;
+          f.code=code; f.a=a; f.b=b;
+          send( _client, f);
+          _replied=true;
+        }
+
+  int open()
+        {
+          if(_reactor.fd()<0) {
+            std::cerr << "SocketInterface needs epoll" << std::endl;
+            return -ENOSYS;
+          }
+          sockaddr_un addr;
+          if(_path.size()>=sizeof(addr.sun_path)) return -ENAMETOOLONG;
+          _listen=socket(AF_UNIX,SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+          if(_listen<0) return fail("socket");
+          memset(&addr,0,sizeof(addr));
+          addr.sun_family=AF_UNIX;
+          strcpy(addr.sun_path,_path.c_str());
+          // remove a socket left behind by a previous run
+          unlink(_path.c_str());
+          if(bind(_listen,(sockaddr*)&addr,sizeof(addr))<0) return fail("bind");
+          if(listen(_listen,16)<0) return fail("listen");
+          _reactor.add(_listen,POLLIN,
+                       makeTrigger_0(*this,&SocketInterface::accept));
+          if(_debug) std::cerr << "Listening on " << _path << std::endl;
+          return 0;
+        }
+  int close()
+        {
+          if(_listen<0) return 0;
+          while( !_clients.empty()) drop(_clients.begin()->first);
+          reap();
+          _reactor.remove(_listen);
+          ::close(_listen);
+          _listen=-1;
+          unlink(_path.c_str());
+          return 0;
+        }
+  // readable whenever a client connects or sends a frame
+  int  fd() const {return _reactor.fd();}
+  int  process()
+        {
+          _reactor.wait(0);
+          reap();
+          return 0;
+        }
+  void setDebug( bool debug) {_debug=debug;}
+  void addAction( const Action& a, Command* c)
+        {_actions.adopt(a,c);}
+  void resetActions() {_actions.clear();}
+  ActionTable& actions() {return _actions;}
+  void print_status( const std::string& s="")
+        {if(_debug && s.size()) std::cerr << s << std::endl;}
+  void announce( const std::string& s="") {print_status(s);}
+  // there is nobody to ask
+  std::string getString( const std::string&) {return "";}
+  void showHelp() {}
+  void setStatus( int status) {_status = status<0 ? 0 : status;}
+  int  resetControls( char cmd) {_current=cmd;return 0;}
+  // notify subscribers of changes since the last flush
+  void flush()
+        {
+          if(_status==_sentStatus && _current==_sentCurrent) return;
+          _sentStatus=_status; _sentCurrent=_current;
+          Frame f;
+          f.op=OP_EVENT; f.arg=_status; f.seq=0;
+          f.code=0; f.a=(unsigned char)_current; f.b=0;
+          // send() may drop the client
+          for( ClientMap::const_iterator it=_clients.begin();
+               it!=_clients.end(); )
+          {
+            int fd=it->first;
+            bool subscribed=it->second.subscribed;
+            ++it;
+            if(subscribed) send(fd,f);
+          }
+        }
+private:
+  SocketInterface( const SocketInterface&);
+  SocketInterface& operator=( const SocketInterface&);
+
+  std::string _path;
+  int         _listen;
+  bool        _debug;
+  int         _status;
+  char        _current;
+  int         _sentStatus;
+  int         _sentCurrent;
+  Reactor     _reactor;
+  ClientMap   _clients;
+  std::vector<int> _dropped;
+  ActionTable _actions;
+  Command*    _handler;
+  Frame       _request;
+  int         _client;
+  bool        _replied;
+
+  int fail( const char* what)
+        {
+          int ret=-errno;
+          std::cerr << what << " failed with code " << ret << " ("
+                    << strerror(-ret) << ")" << std::endl;
+          if(_listen>=0) ::close(_listen);
+          _listen=-1;
+          return ret;
+        }
+  int accept()
+        {
+          int fd=::accept4(_listen,0,0,SOCK_NONBLOCK|SOCK_CLOEXEC);
+          if(fd<0) return -errno;
+          Client c = {false};
+          _clients[fd]=c;
+          _reactor.add(fd,POLLIN,
+                       makeTrigger_1(*this,&SocketInterface::receive,fd));
+          if(_debug) std::cerr << "Client " << fd << " connected" << std::endl;
+          return 0;
+        }
+  // the client's handler may be running, descriptors are closed by reap()
+  void drop( int fd)
+        {
+          if(!_clients.erase(fd)) return;
+          if(_debug) std::cerr << "Client " << fd << " disconnected"
+                               << std::endl;
+          _dropped.push_back(fd);
+        }
+  void reap()
+        {
+          for( size_t i=0; i<_dropped.size(); ++i)
+          {
+            _reactor.remove(_dropped[i]);
+            ::close(_dropped[i]);
+          }
+          _dropped.clear();
+        }
+  // replies and events are dropped for clients that don't keep up
+  void send( int fd, Frame f)
+        {
+          f.seq=htons(f.seq);
+          f.code=htonl(f.code); f.a=htonl(f.a); f.b=htonl(f.b);
+          if(::send(fd,&f,sizeof(f),MSG_NOSIGNAL|MSG_DONTWAIT)<0 &&
+             errno!=EAGAIN && errno!=EWOULDBLOCK) drop(fd);
+        }
+  int receive( int fd)
+        {
+          if(!_clients.count(fd)) return 0;
+          Frame f;
+          ssize_t n=::recv(fd,&f,sizeof(f),0);
+          if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) return 0;
+          if(n<=0) {drop(fd);return n;}
+          // short frames are padded with zeros
+          if(size_t(n)<sizeof(f)) memset((char*)&f+n,0,sizeof(f)-n);
+          f.seq=ntohs(f.seq);
+          f.code=ntohl(f.code); f.a=ntohl(f.a); f.b=ntohl(f.b);
+          _request=f; _client=fd; _replied=false;
+          int ret=dispatch(fd,f);
+          // the handler may have dropped the client
+          if(!_replied && _clients.count(fd)) reply(ret);
+          return 0;
+        }
+  int dispatch( int fd, const Frame& f)
+        {
+          if(_debug) std::cerr << "Client " << fd << " request " << int(f.op)
+                               << std::endl;
+          switch( f.op)
+          {
+          case OP_SUBSCRIBE:
+            _clients[fd].subscribed=f.arg;
+            return 0;
+          case OP_KEY:
+            return _actions.execute(f.arg);
+          default:
+            if(!_handler) return -ENOSYS;
+            return _handler->execute();
+          }
+        }
+};
+
+// forwards requests of a SocketInterface to a Launcher, blocking
+// functions are run on the launcher's executor
+template<class L>
+class SocketControl : public Command
+{
+public:
+  SocketControl( SocketInterface& s, L& l) : _s(s), _l(l) {}
+  int execute()
+        {
+          const SocketInterface::Frame& f=_s.request();
+          double a=f.a*1e-3, b=f.b*1e-3;
+          switch( f.op)
+          {
+          case SocketInterface::OP_MOVE:
+            return _l.move(f.arg);
+          case SocketInterface::OP_STOP:
+            return _l.halt();
+          case SocketInterface::OP_MOVEABS:
+            return queue(makeTrigger_2(_l,&L::moveAbs,a,b));
+          case SocketInterface::OP_MOVEREL:
+            return queue(makeTrigger_2(_l,&L::moveRel,a,b));
+          case SocketInterface::OP_FIRE:
+            if(f.a) return queue(makeTrigger_1(_l,&L::fireTimeout,a));
+            return queue(makeTrigger_0(_l,&L::fire));
+          case SocketInterface::OP_HOME:
+            return queue(makeTrigger_0(_l,&L::goHome));
+          case SocketInterface::OP_CALIBRATE:
+            return queue(makeTrigger_0(_l,&L::calibrate));
+          case SocketInterface::OP_STATUS:
+            _s.reply(0,int32_t(_l.theta()*1e3),int32_t(_l.phi()*1e3));
+            return 0;
+          }
+          return -EINVAL;
+        }
+private:
+  SocketInterface& _s;
+  L&               _l;
+
+  int queue( Command* c) {return _l.submit(c).valid() ? 0 : -EBUSY;}
+};
+
+#endif
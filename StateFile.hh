@@ -0,0 +1,151 @@
+#ifndef STATEFILE_HH
+#define STATEFILE_HH
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Calibration.hh"
+
+// calibration and last known position of a launcher, kept across restarts
+//
+// The file is mapped, saving is a copy into the page cache that the kernel
+// writes back, no syscall. There are two slots written alternately, each
+// with a sequence number and a checksum, so a crash while saving leaves
+// the previous state readable.
+
+// angles in degrees, times in seconds
+struct SavedState
+{
+  double thetaMin;
+  double thetaMax;
+  double phiMin;
+  double phiMax;
+  // endpoint to endpoint times, 0 if not calibrated
+  double thetaPos;
+  double thetaNeg;
+  double phiPos;
+  double phiNeg;
+  // position, -1 if unknown, and its uncertainty
+  double theta;
+  double phi;
+  double thetaErr;
+  double phiErr;
+  // wall clock time of saving
+  double saved;
+  // speed table points of MSG_DOWN, MSG_UP, MSG_LEFT and MSG_RIGHT
+  double  tableU[4][SpeedTable::POINTS];
+  double  tableT[4][SpeedTable::POINTS];
+  int32_t tablePoints[4];
+};
+
+class StateFile
+{
+public:
+  enum{MAGIC=0x524c5346, VERSION=2};
+  struct Slot
+  {
+    uint32_t  seq;
+    uint32_t  sum;
+    SavedState state;
+  };
+  struct Layout
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t pad;
+    Slot     slots[2];
+  };
+
+  StateFile() : _file(0) {}
+  ~StateFile() {close();}
+  // map path, creating it if needed, files of other versions are reset
+  int open( const std::string& path)
+        {
+          close();
+          int fd=::open(path.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0644);
+          if(fd<0) return -errno;
+          struct stat st;
+          if(fstat(fd,&st)<0 ||
+             (st.st_size!=sizeof(Layout) && ftruncate(fd,sizeof(Layout))<0)) {
+            int ret=-errno;
+            ::close(fd);
+            return ret;
+          }
+          void* p=mmap(0,sizeof(Layout),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+          ::close(fd);
+          if(p==MAP_FAILED) return -errno;
+          _file=static_cast<Layout*>(p);
+          if(_file->magic!=uint32_t(MAGIC) || _file->version!=VERSION ||
+             _file->size!=sizeof(Layout)) {
+            memset(_file,0,sizeof(Layout));
+            _file->magic=MAGIC;
+            _file->version=VERSION;
+            _file->size=sizeof(Layout);
+          }
+          return 0;
+        }
+  // writes back pending changes
+  void close()
+        {
+          if(!_file) return;
+          msync(_file,sizeof(Layout),MS_SYNC);
+          munmap(_file,sizeof(Layout));
+          _file=0;
+        }
+  bool isOpen() const {return _file;}
+  // latest intact state, false if there is none
+  bool load( SavedState& s) const
+        {
+          const Slot* slot=latest();
+          if(!slot) return false;
+          s=slot->state;
+          return true;
+        }
+  void save( const SavedState& s)
+        {
+          if(!_file) return;
+          const Slot* last=latest();
+          uint32_t seq=last ? last->seq+1 : 1;
+          Slot& slot=_file->slots[seq&1];
+          slot.seq=seq;
+          slot.state=s;
+          slot.sum=checksum(slot);
+        }
+private:
+  StateFile( const StateFile&);
+  StateFile& operator=( const StateFile&);
+
+  Layout* _file;
+
+  const Slot* latest() const
+        {
+          if(!_file) return 0;
+          const Slot* best=0;
+          for( int i=0; i<2; ++i)
+          {
+            const Slot& s=_file->slots[i];
+            if(s.seq && s.sum==checksum(s) && (!best || s.seq>best->seq))
+                best=&s;
+          }
+          return best;
+        }
+  // FNV-1a over the sequence number and the state
+  static uint32_t checksum( const Slot& s)
+        {
+          uint32_t h=2166136261u;
+          const unsigned char* p=reinterpret_cast<const unsigned char*>(&s.seq);
+          for( size_t i=0; i<sizeof(s.seq); ++i) h=(h^p[i])*16777619u;
+          p=reinterpret_cast<const unsigned char*>(&s.state);
+          for( size_t i=0; i<sizeof(s.state); ++i) h=(h^p[i])*16777619u;
+          return h;
+        }
+};
+
+#endif
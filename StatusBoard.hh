@@ -0,0 +1,164 @@
+#ifndef STATUSBOARD_HH
+#define STATUSBOARD_HH
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// launcher state published in shared memory
+//
+// Launcher writes the board, any number of processes can map it with
+// StatusBoardReader and take consistent snapshots without syscalls or
+// USB traffic. Updates are protected by a seqlock: the writer makes the
+// sequence number odd while it copies, readers retry if it was odd or
+// changed during their copy.
+
+// snapshot of the launcher, angles in degrees and times in seconds on
+// CLOCK_MONOTONIC (the same for all processes)
+struct BoardState
+{
+  double theta;
+  double phi;
+  double thetaMin;
+  double thetaMax;
+  double phiMin;
+  double phiMax;
+  // endpoint to endpoint times, 0 if not calibrated
+  double thetaPos;
+  double thetaNeg;
+  double phiPos;
+  double phiNeg;
+  // start of the current move, theta/phi are valid at that time
+  double start;
+  // time of publication
+  double time;
+  int32_t status;
+  int32_t current;
+  uint32_t updates;
+  int32_t pid;
+};
+
+class StatusBoard
+{
+public:
+  enum{MAGIC=0x524c5342, VERSION=1};
+  struct Layout
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t size;
+    BoardState state;
+  };
+
+  StatusBoard() : _board(0) {}
+  ~StatusBoard() {close();}
+  // create the shared memory object name (e.g. "/rocketlauncher")
+  int open( const std::string& name)
+        {
+          close();
+          int fd=shm_open(name.c_str(),O_RDWR|O_CREAT,0644);
+          if(fd<0) return -errno;
+          if(ftruncate(fd,sizeof(Layout))<0) {
+            int ret=-errno;
+            ::close(fd);
+            return ret;
+          }
+          void* p=mmap(0,sizeof(Layout),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+          ::close(fd);
+          if(p==MAP_FAILED) return -errno;
+          _board=static_cast<Layout*>(p);
+          _name=name;
+          memset(&_board->state,0,sizeof(_board->state));
+          _board->size=sizeof(Layout);
+          _board->version=VERSION;
+          __atomic_store_n(&_board->seq,0,__ATOMIC_RELEASE);
+          __atomic_store_n(&_board->magic,uint32_t(MAGIC),__ATOMIC_RELEASE);
+          return 0;
+        }
+  void close()
+        {
+          if(!_board) return;
+          munmap(_board,sizeof(Layout));
+          shm_unlink(_name.c_str());
+          _board=0;
+        }
+  bool isOpen() const {return _board;}
+  void publish( const BoardState& s)
+        {
+          if(!_board) return;
+          uint32_t seq=_board->seq;
+          __atomic_store_n(&_board->seq,seq+1,__ATOMIC_RELAXED);
+          __atomic_thread_fence(__ATOMIC_RELEASE);
+          _board->state=s;
+          __atomic_store_n(&_board->seq,seq+2,__ATOMIC_RELEASE);
+        }
+private:
+  StatusBoard( const StatusBoard&);
+  StatusBoard& operator=( const StatusBoard&);
+
+  Layout*     _board;
+  std::string _name;
+};
+
+class StatusBoardReader
+{
+public:
+  StatusBoardReader() : _board(0) {}
+  ~StatusBoardReader() {close();}
+  int open( const std::string& name)
+        {
+          close();
+          int fd=shm_open(name.c_str(),O_RDONLY,0);
+          if(fd<0) return -errno;
+          void* p=mmap(0,sizeof(StatusBoard::Layout),PROT_READ,MAP_SHARED,
+                       fd,0);
+          ::close(fd);
+          if(p==MAP_FAILED) return -errno;
+          _board=static_cast<const StatusBoard::Layout*>(p);
+          if(__atomic_load_n(&_board->magic,__ATOMIC_ACQUIRE)!=
+             uint32_t(StatusBoard::MAGIC) ||
+             _board->version!=StatusBoard::VERSION) {
+            close();
+            return -EPROTO;
+          }
+          return 0;
+        }
+  void close()
+        {
+          if(!_board) return;
+          munmap(const_cast<StatusBoard::Layout*>(_board),
+                 sizeof(StatusBoard::Layout));
+          _board=0;
+        }
+  // consistent copy of the state, false if the board isn't open or the
+  // writer died while publishing
+  bool read( BoardState& s) const
+        {
+          if(!_board) return false;
+          for( int spins=0; spins<1000000; ++spins)
+          {
+            uint32_t seq=__atomic_load_n(&_board->seq,__ATOMIC_ACQUIRE);
+            if(seq&1) continue;
+            s=_board->state;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&_board->seq,__ATOMIC_RELAXED)==seq)
+                return true;
+          }
+          return false;
+        }
+  // number of publications so far, cheap check for changes
+  uint32_t sequence() const
+        {
+          return _board ? __atomic_load_n(&_board->seq,__ATOMIC_ACQUIRE)/2 : 0;
+        }
+private:
+  const StatusBoard::Layout* _board;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef THREAD_HH
+#define THREAD_HH
+
+#include <pthread.h>
+
+// recursive mutex that can be released completely around blocking waits
+class Mutex
+{
+public:
+  Mutex() : _depth(0), _owned(false) {pthread_mutex_init(&_m,0);}
+  ~Mutex() {pthread_mutex_destroy(&_m);}
+  void lock()
+        {
+          if(owner()) {++_depth; return;}
+          pthread_mutex_lock(&_m);
+          _owner=pthread_self();
+          __atomic_store_n(&_owned,true,__ATOMIC_RELEASE);
+          _depth=1;
+        }
+  void unlock()
+        {
+          if(!owner() || --_depth) return;
+          __atomic_store_n(&_owned,false,__ATOMIC_RELEASE);
+          pthread_mutex_unlock(&_m);
+        }
+  // drop all levels held by the calling thread, returns how many
+  int release()
+        {
+          if(!owner()) return 0;
+          int depth=_depth;
+          _depth=1;
+          unlock();
+          return depth;
+        }
+  void reacquire( int depth)
+        {
+          if(!depth) return;
+          lock();
+          _depth=depth;
+        }
+  bool owner() const
+        {
+          return __atomic_load_n(&_owned,__ATOMIC_ACQUIRE) &&
+              pthread_equal(_owner,pthread_self());
+        }
+private:
+  Mutex( const Mutex&);
+  Mutex& operator=( const Mutex&);
+
+  pthread_mutex_t _m;
+  pthread_t       _owner;
+  int             _depth;
+  bool            _owned;
+};
+
+// holds m for the lifetime of the guard
+class Guard
+{
+public:
+  Guard( Mutex& m) : _m(m) {_m.lock();}
+  ~Guard() {_m.unlock();}
+private:
+  Mutex& _m;
+};
+
+// releases m for the lifetime of the object if the thread holds it
+class Unguard
+{
+public:
+  Unguard( Mutex& m) : _m(m), _depth(m.release()) {}
+  ~Unguard() {_m.reacquire(_depth);}
+private:
+  Mutex& _m;
+  int    _depth;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+// hot path tracing, compiled in with 'make TRACE=1' (-DHAVE_TRACE)
+//
+// Each thread records into its own ring buffer, so a trace point costs a
+// clock read and a few stores. Trace::dump() writes the most recent
+// events of all threads as Chrome trace JSON, to be loaded in
+// chrome://tracing or ui.perfetto.dev. Names must be string literals.
+//
+//   TRACE_SCOPE("send");             duration of the enclosing block
+//   TRACE_INSTANT("deadline", late); point event with a value
+//   TRACE_COUNTER("queue", n);       counter track
+//   TRACE_THREAD("executor");        name of the calling thread
+
+#ifdef HAVE_TRACE
+
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <cerrno>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+class Trace
+{
+public:
+  enum{RING_SIZE=1<<16};
+  struct Event
+  {
+    uint64_t    ts;
+    uint64_t    dur;
+    const char* name;
+    double      value;
+    char        phase;
+  };
+  // events of one thread, written by that thread only
+  struct Buffer
+  {
+    Buffer( int t) : tid(t), name(0), head(0) {}
+    int         tid;
+    const char* name;
+    unsigned    head;
+    Event       ring[RING_SIZE];
+  };
+
+  static uint64_t now()
+        {
+          timespec ts;
+          clock_gettime( CLOCK_MONOTONIC, &ts);
+          return uint64_t(ts.tv_sec)*1000000000ull + ts.tv_nsec;
+        }
+  static void record( char phase, const char* name, uint64_t ts,
+                      uint64_t dur=0, double value=0)
+        {
+          Buffer* b=buffer();
+          Event& e=b->ring[b->head%RING_SIZE];
+          e.ts=ts; e.dur=dur; e.name=name; e.value=value; e.phase=phase;
+          __atomic_store_n(&b->head,b->head+1,__ATOMIC_RELEASE);
+        }
+  static void setThreadName( const char* name) {buffer()->name=name;}
+  // write all buffered events to file, events recorded while dumping
+  // may show up garbled, returns the number of events or -errno
+  static int dump( const char* file)
+        {
+          std::ofstream os(file);
+          if(!os) return -errno;
+          Registry& r=registry();
+          pthread_mutex_lock(&r.mutex);
+          int n=0;
+          os << std::fixed << std::setprecision(3);
+          os << "{\"traceEvents\":[\n";
+          for( size_t i=0; i<r.buffers.size(); ++i)
+          {
+            const Buffer* b=r.buffers[i];
+            if(b->name)
+                os << (n++ ? ",\n" : "")
+                   << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                   << "\"tid\":" << b->tid << ",\"args\":{\"name\":\""
+                   << b->name << "\"}}";
+            unsigned head=__atomic_load_n(&b->head,__ATOMIC_ACQUIRE);
+            unsigned first = head>RING_SIZE ? head-RING_SIZE : 0;
+            for( unsigned j=first; j<head; ++j)
+            {
+              const Event& e=b->ring[j%RING_SIZE];
+              os << (n++ ? ",\n" : "") << "{\"ph\":\"" << e.phase
+                 << "\",\"name\":\"" << e.name << "\",\"pid\":1,\"tid\":"
+                 << b->tid << ",\"ts\":" << micros(e.ts);
+              if(e.phase=='X') os << ",\"dur\":" << micros(e.dur);
+              if(e.phase=='i') os << ",\"s\":\"t\"";
+              if(e.phase=='C')
+                  os << ",\"args\":{\"" << e.name << "\":" << e.value << "}";
+              else if(e.phase=='i')
+                  os << ",\"args\":{\"value\":" << e.value << "}";
+              os << "}";
+            }
+          }
+          os << "\n]}\n";
+          pthread_mutex_unlock(&r.mutex);
+          return os ? n : -EIO;
+        }
+private:
+  struct Registry
+  {
+    Registry() {pthread_mutex_init(&mutex,0);}
+    pthread_mutex_t      mutex;
+    std::vector<Buffer*> buffers;
+  };
+  static Registry& registry() {static Registry r; return r;}
+  // buffers outlive their threads so that dumps still show them
+  static Buffer* buffer()
+        {
+          static __thread Buffer* b=0;
+          if(b) return b;
+          Registry& r=registry();
+          pthread_mutex_lock(&r.mutex);
+          b=new Buffer(r.buffers.size()+1);
+          r.buffers.push_back(b);
+          pthread_mutex_unlock(&r.mutex);
+          return b;
+        }
+  static double micros( uint64_t ns) {return ns*1e-3;}
+};
+
+// records the lifetime of the object as a complete ('X') event
+class TraceScope
+{
+public:
+  TraceScope( const char* name) : _name(name), _start(Trace::now()) {}
+  ~TraceScope() {Trace::record('X',_name,_start,Trace::now()-_start);}
+private:
+  const char* _name;
+  uint64_t    _start;
+};
+
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+#define TRACE_SCOPE(name) \
+  TraceScope TRACE_CONCAT(_traceScope,__LINE__)(name)
+#define TRACE_INSTANT(name,value) \
+  Trace::record('i',name,Trace::now(),0,value)
+#define TRACE_COUNTER(name,value) \
+  Trace::record('C',name,Trace::now(),0,value)
+#define TRACE_THREAD(name) Trace::setThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_INSTANT(name,value)
+#define TRACE_COUNTER(name,value)
+#define TRACE_THREAD(name)
+
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef TRAFFICLOG_HH
+#define TRAFFICLOG_HH
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// binary log of the calls to a MsgIface, written by RecordInterface and
+// served by ReplayInterface
+//
+// A header followed by fixed size records in call order, times are
+// seconds since the log was started. Records are buffered and appended in
+// blocks of BLOCK, a crash loses at most one block and a torn record at the
+// end is ignored.
+
+struct TrafficRecord
+{
+  enum Op {OPEN, CLOSE, POST, POST_READ, SEND, READ, RECOVER};
+  // completion time of the call
+  double  time;
+  int32_t ret;
+  uint8_t op;
+  // message sent, status read
+  char    arg;
+  uint8_t pad[2];
+};
+
+struct TrafficHeader
+{
+  enum{MAGIC=0x524c544c, VERSION=1};
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t pad;
+};
+
+// append-only writer
+class TrafficWriter
+{
+public:
+  enum{BLOCK=256};
+  TrafficWriter() : _fd(-1), _count(0) {}
+  ~TrafficWriter() {close();}
+  // truncate path and write the header
+  int open( const std::string& path)
+        {
+          close();
+          _fd=::open(path.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+          if(_fd<0) return -errno;
+          TrafficHeader h;
+          memset(&h,0,sizeof(h));
+          h.magic=TrafficHeader::MAGIC;
+          h.version=TrafficHeader::VERSION;
+          h.recordSize=sizeof(TrafficRecord);
+          if(::write(_fd,&h,sizeof(h))!=ssize_t(sizeof(h))) {
+            int ret=-errno;
+            close();
+            return ret;
+          }
+          return 0;
+        }
+  int close()
+        {
+          if(_fd<0) return 0;
+          int ret=flush();
+          ::close(_fd);
+          _fd=-1;
+          return ret;
+        }
+  bool isOpen() const {return _fd>=0;}
+  void add( double time, int op, char arg, int ret)
+        {
+          if(_fd<0) return;
+          TrafficRecord& r=_block[_count];
+          memset(&r,0,sizeof(r));
+          r.time=time; r.ret=ret; r.op=op; r.arg=arg;
+          if(++_count==BLOCK) flush();
+        }
+  int flush()
+        {
+          if(_fd<0 || !_count) return 0;
+          ssize_t size=_count*sizeof(TrafficRecord);
+          _count=0;
+          ssize_t n=::write(_fd,_block,size);
+          if(n<0) return -errno;
+          return n==size ? 0 : -EIO;
+        }
+private:
+  TrafficWriter( const TrafficWriter&);
+  TrafficWriter& operator=( const TrafficWriter&);
+
+  int           _fd;
+  size_t        _count;
+  TrafficRecord _block[BLOCK];
+};
+
+// read-only mapping of a log
+class TrafficReader
+{
+public:
+  TrafficReader() : _map(0), _size(0) {}
+  ~TrafficReader() {close();}
+  int open( const std::string& path)
+        {
+          close();
+          int fd=::open(path.c_str(),O_RDONLY|O_CLOEXEC);
+          if(fd<0) return -errno;
+          struct stat st;
+          if(fstat(fd,&st)<0) {
+            int ret=-errno;
+            ::close(fd);
+            return ret;
+          }
+          if(size_t(st.st_size)<sizeof(TrafficHeader)) {
+            ::close(fd);
+            return -EINVAL;
+          }
+          void* p=mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+          ::close(fd);
+          if(p==MAP_FAILED) return -errno;
+          _map=p;
+          _size=st.st_size;
+          const TrafficHeader* h=static_cast<const TrafficHeader*>(_map);
+          if(h->magic!=uint32_t(TrafficHeader::MAGIC) ||
+             h->version!=TrafficHeader::VERSION ||
+             h->recordSize!=sizeof(TrafficRecord)) {
+            close();
+            return -EINVAL;
+          }
+          return 0;
+        }
+  void close()
+        {
+          if(!_map) return;
+          munmap(_map,_size);
+          _map=0;
+          _size=0;
+        }
+  bool isOpen() const {return _map;}
+  size_t size() const
+        {
+          return _map ?
+              (_size-sizeof(TrafficHeader))/sizeof(TrafficRecord) : 0;
+        }
+  const TrafficRecord& operator[]( size_t i) const
+        {
+          return reinterpret_cast<const TrafficRecord*>(
+              static_cast<const char*>(_map)+sizeof(TrafficHeader))[i];
+        }
+private:
+  TrafficReader( const TrafficReader&);
+  TrafficReader& operator=( const TrafficReader&);
+
+  void*  _map;
+  size_t _size;
+};
+
+#endif
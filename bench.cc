@@ -0,0 +1,336 @@
+#include "Launcher.hh"
+#include "Histogram.hh"
+#include "ActionTable.hh"
+#include "RecordInterface.hh"
+#include "ReplayInterface.hh"
+
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <getopt.h>
+
+#ifdef HAVE_LIBUSB10
+#include "LibUSB10Interface.hh"
+typedef LibUSB10Interface USBInterface;
+#endif
+
+#ifdef HAVE_LIBUSB
+#include "LibUSBInterface.hh"
+typedef LibUSBInterface USBInterface;
+#endif
+
+#ifdef HAVE_IOKIT
+#include "IOKitInterface.hh"
+typedef IOKitInterface USBInterface;
+#endif
+
+#ifdef HAVE_SIMULATION
+#include "SimulatedInterface.hh"
+typedef SimulatedInterface<> USBInterface;
+#endif
+
+// user interface without a terminal, counts published status updates
+class BenchInterface
+{
+public:
+  BenchInterface() : _debug(false), _updates(0) {_pipe[0]=_pipe[1]=-1;}
+  ~BenchInterface() {close();}
+  int  open()  {return pipe(_pipe)<0 ? -errno : 0;}
+  int  close()
+        {
+          if(_pipe[0]<0) return 0;
+          ::close(_pipe[0]); ::close(_pipe[1]);
+          _pipe[0]=_pipe[1]=-1;
+          return 0;
+        }
+  int  fd() const {return _pipe[0];}
+  int  process() {return 0;}
+  void setDebug( bool debug) {_debug=debug;}
+  void addAction( const Action&, Command* c) {delete c;}
+  void print_status( const std::string& s="")
+        {if(_debug && s.size()) std::cerr << s << std::endl;}
+  void announce( const std::string& s="") {print_status(s);}
+  std::string getString( const std::string&) {return "";}
+  void showHelp() {}
+  void setStatus( int) {++_updates;}
+  void resetControls( char) {}
+  void flush() {}
+  unsigned long updates() const {return _updates;}
+private:
+  int  _pipe[2];
+  bool _debug;
+  unsigned long _updates;
+};
+
+// the device traffic can be recorded, a replayed log replaces the device
+typedef Launcher<RecordInterface<USBInterface>,BenchInterface> BenchLauncher;
+typedef Launcher<ReplayInterface<>,BenchInterface> ReplayLauncher;
+
+// target of the dispatch benchmark
+struct Counter
+{
+  Counter() : n(0) {}
+  int add( int i) {n+=i;return 0;}
+  long n;
+};
+
+// planning time and planned travel time against visiting in the given
+// order for n random targets, no device needed
+static int plan( BenchLauncher& l, int count, int n)
+{
+  srand(1);
+  std::vector<Target> targets(n);
+  std::vector<int> order;
+  double planned=0, given=0;
+  Histogram h;
+  for( int i=0; i<count; ++i)
+  {
+    for( int k=0; k<n; ++k)
+        targets[k]=Target( l.thetaMin()+l.thetaRange()*rand()/RAND_MAX,
+                           l.phiMin()+l.phiRange()*rand()/RAND_MAX);
+    double t=SystemClock::now();
+    planned+=l.planSequence( targets, order);
+    h.add( SystemClock::now()-t);
+    double theta=l.theta(), phi=l.phi();
+    for( int k=0; k<n; ++k)
+    {
+      given+=l.moveTime( theta, phi, targets[k].theta, targets[k].phi);
+      theta=targets[k].theta; phi=targets[k].phi;
+    }
+  }
+  std::printf( "%-8s %5s %7s %9s %9s %9s %9s  [ms, s]\n", "plan", "n",
+               "plans", "mean", "p99", "max", "saved");
+  std::printf( "%-8s %5d %7d %9.4f %9.4f %9.4f %8.1f%%\n",
+               n<=Planner::EXACT ? "exact" : "2-opt", n, count,
+               h.mean()*1e3, h.percentile(0.99)*1e3, h.max()*1e3,
+               100*(1-planned/given));
+  return 0;
+}
+
+// key dispatch through allocated triggers found by a linear search, as
+// the UIs did before ActionTable, against ActionTable, no device needed
+static int dispatch( int count, int keys)
+{
+  typedef std::vector<std::pair<Action,Command*> > ActionVec;
+  Counter c;
+  ActionVec vec;
+  ActionTable table;
+  for( int k=0; k<keys; ++k)
+  {
+    Action a( char(k), "bench");
+    vec.push_back( std::make_pair(a,makeTrigger_1(c,&Counter::add,1)));
+    table.bind( a, makeCall_1(c,&Counter::add,1));
+  }
+  std::printf( "%-8s %5s %10s %9s  [ns/key]\n", "dispatch", "keys", "n",
+               "mean");
+  for( int pass=0; pass<2; ++pass)
+  {
+    double start=SystemClock::now();
+    for( int i=0; i<count; ++i)
+    {
+      char key=char(i%keys);
+      if(pass==0) {
+        for( ActionVec::const_iterator it=vec.begin(); it!=vec.end(); ++it)
+            if( it->first._key==key) {it->second->execute();break;}
+      }
+      else table.execute( (unsigned char)key);
+    }
+    double total=SystemClock::now()-start;
+    std::printf( "%-8s %5d %10d %9.2f\n", pass ? "table" : "linear",
+                 keys, count, total/count*1e9);
+  }
+  for( ActionVec::const_iterator it=vec.begin(); it!=vec.end(); ++it)
+      delete it->second;
+  // both passes executed every key
+  return c.n==2L*count ? 0 : -1;
+}
+
+enum Mode {SEND,READ,MOVE,POLL,IDLE,MODES};
+static const char* modeNames[MODES] = {"send","read","move","poll","idle"};
+
+// one transaction of the given mode, i counts iterations
+template<class L>
+int transaction( L& l, int mode, int i)
+{
+  // small back and forth steps so that the device ends where it started
+  static const char steps[4] = {MSG_LEFT,MSG_STOP,MSG_RIGHT,MSG_STOP};
+  char status;
+  switch( mode)
+  {
+  case SEND:
+    // stop is the only command that doesn't move the device
+    return l.device().send(MSG_STOP);
+  case READ:
+    return l.device().read(&status);
+  case MOVE:
+    // command and status round trip through the launcher
+    l.move(steps[i%4]);
+    return l.update_status();
+  case POLL:
+  {
+    // command until the main loop has published the next status
+    unsigned long n=l.ui().updates();
+    l.move(steps[i%4]);
+    while( l.ui().updates()==n) l.process();
+    return 0;
+  }
+  case IDLE:
+    // one status poll of the main loop of a launcher standing still
+    return l.process() ? 0 : -1;
+  }
+  return -1;
+}
+
+// transactions of the modes first to last on a connected launcher
+template<class L>
+int measure( L& l, int first, int last, int count, int warmup,
+             bool histograms, const char* trace)
+{
+  int ret;
+  if((ret=l.connect())) {
+    std::cerr << "Connecting to launcher failed with code " << ret
+              << std::endl;
+    return ret;
+  }
+  std::printf( "%-6s %7s %10s %9s %9s %9s %9s %9s %9s  [ms]\n",
+               "mode", "n", "ops/s", "min", "mean", "p50", "p99", "p999",
+               "max");
+  Histogram h;
+  for( int mode=first; mode<=last; ++mode)
+  {
+    h.reset();
+    int errors=0;
+    for( int i=0; i<warmup; ++i) transaction( l, mode, i);
+    double start=SystemClock::now();
+    for( int i=0; i<count; ++i)
+    {
+      double t=SystemClock::now();
+      if(transaction( l, mode, i)<0) ++errors;
+      h.add( SystemClock::now()-t);
+    }
+    double total=SystemClock::now()-start;
+    std::printf( "%-6s %7lu %10.1f %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f\n",
+                 modeNames[mode], (unsigned long)h.count(), count/total,
+                 h.min()*1e3, h.mean()*1e3, h.percentile(0.5)*1e3,
+                 h.percentile(0.99)*1e3, h.percentile(0.999)*1e3,
+                 h.max()*1e3);
+    if(errors) std::printf( "%-6s %d transactions failed\n",
+                            modeNames[mode], errors);
+    if(histograms) {
+      std::fflush( stdout);
+      h.print( std::cout);
+    }
+  }
+  l.move( MSG_STOP);
+  if(trace) {
+    ret=l.dumpTrace( trace);
+    if(ret<0) std::cerr << "Writing trace failed with code " << ret
+                        << std::endl;
+    else      std::cout << ret << " trace events written to " << trace
+                        << std::endl;
+  }
+  return l.disconnect();
+}
+
+static void usage( const char* name)
+{
+  std::cerr << "Usage: " << name << " [options]\n"
+            << "  -m mode   send, read, move, poll or all (default),\n"
+            << "            idle times main loop iterations at rest\n"
+            << "            dispatch compares key lookups without device\n"
+            << "            plan times target ordering without device\n"
+            << "  -k keys   bound keys for dispatch (200), targets for plan"
+            << " (12)\n"
+            << "  -C        plan with both axes moving at once (combined"
+            << " direction bits)\n"
+            << "  -n count  transactions per mode (1000)\n"
+            << "  -w count  warm-up transactions per mode (10)\n"
+            << "  -c sec    status cache freshness (0, always read)\n"
+            << "  -i sec    launcher status poll interval (0.05)\n"
+            << "  -I sec    longest status poll interval at rest (2)\n"
+            << "  -H        print latency histograms\n"
+            << "  -t file   write trace events ('make TRACE=1')\n"
+            << "  -r log    record the device traffic to log\n"
+            << "  -R log    replay log as fast as possible instead of the"
+            << " device\n"
+            << "  -d        debug output" << std::endl;
+}
+
+int main( int argc, char** argv)
+{
+  // idle polls take seconds, only on request
+  int    count=1000, warmup=10, first=0, last=POLL, keys=-1;
+  double freshness=0, interval=-1, idle=-1;
+  bool   histograms=false, debug=false, keyDispatch=false, planning=false;
+  bool   replay=false, combined=false;
+  const char* trace=0;
+  const char* traffic=0;
+  int c;
+  while( (c=getopt(argc,argv,"m:n:w:c:i:I:k:CHt:r:R:dh"))!=-1)
+  {
+    switch( c)
+    {
+    case 'm':
+      if(std::string(optarg)=="all") break;
+      if(std::string(optarg)=="dispatch") {keyDispatch=true;break;}
+      if(std::string(optarg)=="plan") {planning=true;break;}
+      for( first=0; first<MODES && modeNames[first]!=std::string(optarg);
+           ++first);
+      if(first==MODES) {usage(argv[0]);return 1;}
+      last=first;
+      break;
+    case 'n': count=atoi(optarg); break;
+    case 'w': warmup=atoi(optarg); break;
+    case 'c': freshness=atof(optarg); break;
+    case 'i': interval=atof(optarg); break;
+    case 'I': idle=atof(optarg); break;
+    case 'k': keys=atoi(optarg); break;
+    case 'C': combined=true; break;
+    case 'H': histograms=true; break;
+    case 't': trace=optarg; break;
+    case 'r': traffic=optarg; replay=false; break;
+    case 'R': traffic=optarg; replay=true; break;
+    case 'd': debug=true; break;
+    default:  usage(argv[0]); return 1;
+    }
+  }
+  if(count<1 || !keys || keys>ActionTable::KEYS) {usage(argv[0]);return 1;}
+  if(keyDispatch) return dispatch( count, keys<0 ? 200 : keys);
+
+  BenchLauncher l(0x0a81, 0x0701);
+  l.setDebug( debug);
+  l.device().setStatusFreshness( freshness);
+  if(interval>0) l.setPollInterval( interval);
+  if(idle>0) l.setIdlePollInterval( idle);
+  if(planning) {
+    // configured like main.cc, the unknown start position counts as the
+    // lower endpoints, -C selects the cost model of main.cc -c
+    l.setThetaPosNeg( 2.95986, 2.76801);
+    l.setPhiPosNeg( 19.5367, 19.857);
+    l.setCombinedMoves( combined);
+    return plan( l, count, keys<0 ? 12 : keys);
+  }
+  if(replay) {
+    ReplayLauncher r(0x0a81, 0x0701);
+    r.setDebug( debug);
+    r.device().setLog( traffic);
+    // as fast as possible
+    r.device().setRealtime( false);
+    if(interval>0) r.setPollInterval( interval);
+    if(idle>0) r.setIdlePollInterval( idle);
+    int ret=measure( r, first, last, count, warmup, histograms, trace);
+    std::printf( "replayed %lu of %lu records, %lu diverged\n",
+                 (unsigned long)r.device().position(),
+                 (unsigned long)r.device().size(),
+                 (unsigned long)r.device().diverged());
+    return ret;
+  }
+  int ret;
+  if(traffic && (ret=l.device().record( traffic))) {
+    std::cerr << "Opening traffic log " << traffic << " failed with code "
+              << ret << std::endl;
+    return ret;
+  }
+  return measure( l, first, last, count, warmup, histograms, trace);
+}
\ No newline at end of file
@@ -3,6 +3,16 @@
 #include "CursesInterface.hh"
 typedef CursesInterface ControlInterface;
 
+#include "SocketInterface.hh"
+#include "RecordInterface.hh"
+#include "ReplayInterface.hh"
+#include "Fleet.hh"
+
+#include <string>
+#include <csignal>
+#include <cstdlib>
+#include <getopt.h>
+
 #ifdef HAVE_LIBUSB10
 #include "LibUSB10Interface.hh"
 typedef LibUSB10Interface USBInterface;
@@ -18,70 +28,304 @@ typedef LibUSBInterface USBInterface;
 typedef IOKitInterface USBInterface;
 #endif
 
-int main()
+#ifdef HAVE_SIMULATION
+#include "SimulatedInterface.hh"
+typedef SimulatedInterface<> USBInterface;
+#endif
+
+static volatile sig_atomic_t quit = 0;
+// shared memory status board, empty for none
+static std::string board;
+// calibration and position kept across restarts, empty for none
+static std::string state;
+// USB traffic log written or replayed instead of the device, empty for none
+static std::string traffic;
+// path of the device to open, empty for the first one found
+static std::string device;
+// send combined direction bits to move both axes at once, unconfirmed on
+// the hardware, so off by default
+static bool combined = false;
+static void onSignal( int) {quit = 1;}
+
+// settings shared by the keyboard and the daemon front end
+template<class L>
+void configure( L& l)
 {
-  typedef Launcher<USBInterface,ControlInterface> MyLauncher;
-  // create launcher for given vendor and device ids
-  MyLauncher l(0x0a81, 0x0701);
   // set times for moving between the two endpoints of each angular direction
   // produced by Launcher::calibrate
   l.setThetaPosNeg( 2.95986, 2.76801);
   l.setPhiPosNeg( 19.5367, 19.857);
-  // define key shortcuts/actions (see Command.hh)
-  l.addAction( Action( 'a', "Move left",  0,-3, true, MSG_LEFT),
-               makeTrigger_1(l,&MyLauncher::move,char(MSG_LEFT)));
-  l.addAction( Action( 'd', "Move right", 0, 3, true, MSG_RIGHT),
-               makeTrigger_1(l,&MyLauncher::move,char(MSG_RIGHT)));
-  l.addAction( Action( 'w', "Move up",   -2, 0, true, MSG_UP),
-               makeTrigger_1(l,&MyLauncher::move,char(MSG_UP)));
-  l.addAction( Action( 's', "Move down",  2, 0, true, MSG_DOWN),
-               makeTrigger_1(l,&MyLauncher::move,char(MSG_DOWN)));
-  l.addAction( Action( ' ', "Stop"),
-               makeTrigger_1(l, &MyLauncher::move,char(MSG_STOP)));
-  // approximately 5.5s needed for charging and releasing the air
-  l.addAction( Action( 'f', "Single-shot fire, blocking"),
-               makeTrigger_0(l, &MyLauncher::fire));
-  l.addAction( Action( 'F', "Single-shot fire, stopped by timeout"),
-               makeTrigger_1(l, &MyLauncher::fireTimeout,5.5));
-  l.addAction( Action( 'E', "Single-shot fire, stopped by status update"),
-               makeTrigger_1(l, &MyLauncher::move,char(MSG_FIRE)));
-  l.addAction( Action( '1', "Move to kitchen"),
-               makeTrigger_2(l, &MyLauncher::moveAbs, 65.,110.));
-  l.addAction( Action( '2', "Move to couch"),
-               makeTrigger_2(l, &MyLauncher::moveAbs, 90.,170.));
-  l.addAction( Action( '3', "Move to bed"),
-               makeTrigger_2(l, &MyLauncher::moveAbs, 90.,235.));
-  l.addAction( Action( '4', "Move to desk"),
-               makeTrigger_2(l, &MyLauncher::moveAbs, 90.,285.));
-  l.addAction( Action( 'h', "Go home"),
-               makeTrigger_0(l, &MyLauncher::goHome));
-  l.addAction( Action( 'c', "Calibrate"),
-               makeTrigger_0( l, &MyLauncher::calibrate));
-  l.addAction( Action( 'p', "Print position parameters"),
-               makeTrigger_0( l, &MyLauncher::printStatusPV));
-  l.addAction( Action( 'm', "Print movement parameters"),
-               makeTrigger_0( l, &MyLauncher::printStatusMV));
-  l.addAction( Action( 'q', "Quit"),
-               makeTrigger_0( l, &MyLauncher::stop));
-  l.addAction( Action( 'g', "Go relative"),
-               makeTrigger_0( l, &MyLauncher::goRel));
-  l.addAction( Action( 'z', "Go absolute"),
-               makeTrigger_0( l, &MyLauncher::goAbs));
-  l.addAction( Action( '?', "Print help"),
-               makeTrigger_0( l, &MyLauncher::printHelp));
-
+  // -c: the device accepts combined direction bits, e.g.
+  // MSG_DOWN|MSG_LEFT, and diagonal moves take the longer axis time.
+  // Without it moveRel() moves the axes one after the other, taking the
+  // sum of both times, no speedup over moving them separately.
+  l.setCombinedMoves( combined);
   // for debug mode: 'mknod errpipe p' and start with
   // './rocketlauncher 2>errpipe'
   // 'tail -f errpipe' in a 2nd terminal
 #ifdef DEBUG
   l.setDebug( true);
 #endif
+}
+
+// file and board names of a fleet member get its path appended
+static std::string member( const std::string& name, const std::string& path)
+{
+  return name.empty() || path.empty() ? name : name+"."+path;
+}
 
-  // connect to launcher and update the event loop once every 50ms
+// select the device and start recording, or select the log to replay
+static int prepare( RecordInterface<USBInterface>& d, const std::string& path)
+{
+  int ret;
+  if(path.empty()) d.setPath( device);
+  std::string log=member( traffic, path);
+  if(log.size() && (ret=d.record( log))) {
+    std::cerr << "Opening traffic log " << log << " failed with code "
+              << ret << " (" << strerror(-ret) << ")" << std::endl;
+    return ret;
+  }
+  return 0;
+}
+static int prepare( ReplayInterface<>& d, const std::string&)
+{
+  d.setLog( traffic);
+  return 0;
+}
+
+// device, status board and state file of a launcher, path is empty
+// unless it is part of a fleet
+template<class L>
+int setup( L& l, const std::string& path)
+{
   int ret;
+  if((ret=prepare( l.device(), path))) return ret;
+  std::string name=member( board, path);
+  if(name.size() && (ret=l.openStatusBoard( name))) {
+    std::cerr << "Opening status board " << name << " failed with code "
+              << ret << " (" << strerror(-ret) << ")" << std::endl;
+    return ret;
+  }
+  name=member( state, path);
+  if(name.size() && (ret=l.openStateFile( name))) {
+    std::cerr << "Opening state file " << name << " failed with code "
+              << ret << " (" << strerror(-ret) << ")" << std::endl;
+    return ret;
+  }
+  return 0;
+}
+
+// connect to launcher and run the event loop, process() sleeps until
+// there is input, USB activity or a status update is due
+template<class L>
+int run( L& l)
+{
+  TRACE_THREAD("main");
+  int ret;
+  if((ret=setup( l, ""))) return ret;
   if((ret=l.connect())) return ret;
-  while((ret=l.process())) {usleep(50000);}
+  while( !quit && l.process()) {}
   if((ret=l.disconnect())) return ret;
-    
   return 0;
 }
+
+// socket and requests of a headless launcher
+template<class L>
+void serve( L& l, const std::string& socket)
+{
+  configure( l);
+  l.ui().setPath( socket);
+  l.ui().setHandler( new SocketControl<L>( l.ui(), l));
+  // extra functions for KEY requests
+  l.bind( Action( 'q', "Quit"),
+          makeCall_0( l, &L::stop));
+  l.bind( Action( 't', "Dump trace to rocketlauncher-trace.json"),
+          makeCall_1( l, &L::dumpTrace,
+                      "rocketlauncher-trace.json"));
+}
+
+// headless mode, see SocketInterface.hh for the protocol
+template<class Device>
+int runDaemon( const char* path)
+{
+  typedef Launcher<Device,SocketInterface> DaemonLauncher;
+  DaemonLauncher l(0x0a81, 0x0701);
+  serve( l, path);
+  // shut down cleanly, removing the socket
+  signal( SIGINT,  &onSignal);
+  signal( SIGTERM, &onSignal);
+  return run( l);
+}
+
+// headless mode for all connected launchers in one process, each gets
+// the socket, board, state file and traffic log names with its path
+// appended
+template<class Device>
+int runFleet( const char* path)
+{
+  TRACE_THREAD("main");
+  typedef Fleet<Device,SocketInterface> DaemonFleet;
+  DaemonFleet f(0x0a81, 0x0701);
+  int ret=f.scan();
+  if(ret<=0) {
+    if(!ret) ret=-ENODEV;
+    std::cerr << "Finding launchers failed with code " << ret << " ("
+              << strerror(-ret) << ")" << std::endl;
+    return ret;
+  }
+  for( size_t i=0; i<f.size(); ++i)
+  {
+    serve( f[i], member( path, f.path(i)));
+    // fire commands arrive together 0.25s after the key request
+    f[i].bind( Action( 'S', "Salvo, fire all launchers at once"),
+               makeCall_1( f, &DaemonFleet::salvo, 0.25));
+    if((ret=setup( f[i], f.path(i)))) return ret;
+  }
+  signal( SIGINT,  &onSignal);
+  signal( SIGTERM, &onSignal);
+  if((ret=f.connect())) {
+    f.disconnect();
+    return ret;
+  }
+  while( !quit && f.process()) {}
+  return f.disconnect();
+}
+
+// paths of the connected launchers for -p
+static int list()
+{
+  std::vector<std::string> paths;
+  int ret=RecordInterface<USBInterface>::enumerate( 0x0a81, 0x0701, paths);
+  if(ret<0) {
+    std::cerr << "Finding launchers failed with code " << ret << std::endl;
+    return ret;
+  }
+  for( size_t i=0; i<paths.size(); ++i) std::cout << paths[i] << std::endl;
+  return 0;
+}
+
+// keyboard mode
+template<class Device>
+int runKeyboard()
+{
+  typedef Launcher<Device,ControlInterface> MyLauncher;
+  // create launcher for given vendor and device ids
+  MyLauncher l(0x0a81, 0x0701);
+  configure( l);
+  // define key shortcuts/actions (see ActionTable.hh), blocking functions
+  // are bound with bindAsync() and run on the executor so that the UI keeps
+  // responding and ' ' can cancel them
+  l.bind( Action( 'a', "Move left",  0,-3, true, MSG_LEFT),
+          makeCall_1(l,&MyLauncher::move,char(MSG_LEFT)));
+  l.bind( Action( 'd', "Move right", 0, 3, true, MSG_RIGHT),
+          makeCall_1(l,&MyLauncher::move,char(MSG_RIGHT)));
+  l.bind( Action( 'w', "Move up",   -2, 0, true, MSG_UP),
+          makeCall_1(l,&MyLauncher::move,char(MSG_UP)));
+  l.bind( Action( 's', "Move down",  2, 0, true, MSG_DOWN),
+          makeCall_1(l,&MyLauncher::move,char(MSG_DOWN)));
+  l.bind( Action( ' ', "Stop, cancelling running moves"),
+          makeCall_0(l, &MyLauncher::halt));
+  // approximately 5.5s needed for charging and releasing the air
+  l.bindAsync( Action( 'f', "Single-shot fire, stopped by status bit"),
+               makeCall_0(l, &MyLauncher::fire));
+  l.bindAsync( Action( 'F', "Single-shot fire, stopped by timeout"),
+               makeCall_1(l, &MyLauncher::fireTimeout,5.5));
+  l.bind( Action( 'E', "Single-shot fire, stopped by status update"),
+          makeCall_1(l, &MyLauncher::move,char(MSG_FIRE)));
+  l.bindAsync( Action( '1', "Move to kitchen"),
+               makeCall_2(l, &MyLauncher::moveAbs, 65.,110.));
+  l.bindAsync( Action( '2', "Move to couch"),
+               makeCall_2(l, &MyLauncher::moveAbs, 90.,170.));
+  l.bindAsync( Action( '3', "Move to bed"),
+               makeCall_2(l, &MyLauncher::moveAbs, 90.,235.));
+  l.bindAsync( Action( '4', "Move to desk"),
+               makeCall_2(l, &MyLauncher::moveAbs, 90.,285.));
+  std::vector<Target> places;
+  places.push_back( Target( 65.,110.));
+  places.push_back( Target( 90.,170.));
+  places.push_back( Target( 90.,235.));
+  places.push_back( Target( 90.,285.));
+  l.setSequence( places);
+  l.bindAsync( Action( 'v', "Visit all places in the fastest order"),
+               makeCall_0( l, &MyLauncher::runSequence));
+  l.bindAsync( Action( 'h', "Go home"),
+               makeCall_0(l, &MyLauncher::goHome));
+  l.bindAsync( Action( 'c', "Calibrate"),
+               makeCall_0( l, &MyLauncher::calibrate));
+  l.bindAsync( Action( 'C', "Calibrate speed tables, asks for angles"),
+               makeCall_0( l, &MyLauncher::calibrateTables));
+  l.bind( Action( 'p', "Print position parameters"),
+          makeCall_0( l, &MyLauncher::printStatusPV));
+  l.bind( Action( 'm', "Print movement parameters"),
+          makeCall_0( l, &MyLauncher::printStatusMV));
+  l.bind( Action( 'q', "Quit"),
+          makeCall_0( l, &MyLauncher::stop));
+  l.bind( Action( 'g', "Go relative"),
+          makeCall_0( l, &MyLauncher::goRel));
+  l.bind( Action( 'z', "Go absolute"),
+          makeCall_0( l, &MyLauncher::goAbs));
+  l.bind( Action( 't', "Dump trace to rocketlauncher-trace.json"),
+          makeCall_1( l, &MyLauncher::dumpTrace,
+                      "rocketlauncher-trace.json"));
+  l.bind( Action( '?', "Print help"),
+          makeCall_0( l, &MyLauncher::printHelp));
+  return run( l);
+}
+
+int main( int argc, char** argv)
+{
+  const char* socket=0;
+  bool replay=false, keep=false, all=false;
+  if(getenv("HOME")) state=std::string(getenv("HOME"))+"/.rocketlauncher";
+  int c;
+  while( (c=getopt( argc, argv, "s:b:f:r:R:p:acl"))!=-1) {
+    switch( c) {
+    case 's': socket=optarg; break;
+    case 'b': board=optarg; break;
+    case 'f': state=optarg; keep=true; break;
+    case 'r': traffic=optarg; replay=false; break;
+    case 'R': traffic=optarg; replay=true; break;
+    case 'p': device=optarg; break;
+    case 'a': all=true; break;
+    case 'c': combined=true; break;
+    case 'l': return list();
+    default:
+      std::cerr << "Usage: " << argv[0]
+                << " [-s socket [-a]] [-b board] [-f file] [-r|-R log]"
+                << " [-p path] [-c] [-l]\n"
+                << "  -s socket  run headless, controlled through socket\n"
+                << "  -a         with -s: run all launchers, names get"
+                << " '.path' appended\n"
+                << "  -b board   publish state in shared memory, e.g."
+                << " /rocketlauncher\n"
+                << "  -f file    keep calibration and position in file"
+                << " (~/.rocketlauncher, '' for none)\n"
+                << "  -r log     record USB traffic to log\n"
+                << "  -R log     replay log instead of the device, the"
+                << " state file is only used with -f\n"
+                << "  -p path    use the launcher at path (see -l),"
+                << " default first one\n"
+                << "  -c         move both axes at once with combined"
+                << " direction bits, check\n"
+                << "             that the launcher accepts them first,"
+                << " without it diagonal\n"
+                << "             moves take the sum of both axis times\n"
+                << "  -l         list the paths of connected launchers"
+                << std::endl;
+      return 1;
+    }
+  }
+  if( all && !socket) {
+    std::cerr << "-a requires -s" << std::endl;
+    return 1;
+  }
+  // a replay mustn't overwrite the state of the real device
+  if( replay && !keep) state.clear();
+  if( socket) {
+    if( replay) return runDaemon<ReplayInterface<> >( socket);
+    if( all) return runFleet<RecordInterface<USBInterface> >( socket);
+    return runDaemon<RecordInterface<USBInterface> >( socket);
+  }
+  if( replay) return runKeyboard<ReplayInterface<> >();
+  return runKeyboard<RecordInterface<USBInterface> >();
+}